@@ -0,0 +1,394 @@
+#include "../src/engine.hpp"
+#include "../src/serialize.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Benchmarks of parsing, matching and formatting on synthetic order flow.
+ * Every scenario is generated from a fixed seed, so runs with the same arguments replay the same commands.
+ * Throughput of a stage is measured over the whole stage, latencies are measured per operation on a separate run,
+ * so the timer overhead (tens of nanoseconds) is included in latencies but not in stage throughput
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+/* order flow generators */
+
+/**
+ * xorshift64* generator, small and fast, so generating never dominates the benchmark setup
+ */
+class Random {
+public:
+
+    explicit Random(uint64_t seed) : state(seed != 0 ? seed : 1) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    /**
+     * Uniform integer in [0, bound)
+     */
+    uint64_t below(uint64_t bound) {
+        return next() % bound;
+    }
+
+    /**
+     * Uniform real number in [0, 1)
+     */
+    double real() {
+        return (next() >> 11) * (1.0 / (1ull << 53));
+    }
+
+private:
+
+    uint64_t state;
+};
+
+/**
+ * Parameters of generated order flow, weights of commands are relative
+ */
+struct FlowParams {
+    size_t symbols_cnt;
+    double zipf_exponent; // 0 for uniform symbol popularity
+    double insert_weight;
+    double amend_weight;
+    double pull_weight;
+    int spread_ticks; // passive orders are placed up to this number of ticks away from the mid price
+    double cross_probability; // probability that an insert crosses the mid price
+    double sweep_probability; // probability that an insert is a large order walking through many levels
+};
+
+struct Scenario {
+    char const *name;
+    char const *description;
+    FlowParams params;
+};
+
+static Scenario const SCENARIOS[] = {
+        {"uniform",      "100 symbols of equal popularity, mixed commands",
+                {100,  0,   60, 20, 20, 50,   0.1,  0}},
+        {"zipf",         "1000 symbols with Zipf popularity, mixed commands",
+                {1000, 1.2, 60, 20, 20, 50,   0.1,  0}},
+        {"deep-book",    "4 symbols, orders spread over thousands of levels",
+                {4,    0,   90, 5,  5,  5000, 0.01, 0}},
+        {"cancel-heavy", "most commands pull resting orders",
+                {50,   0,   30, 0,  70, 50,   0.05, 0}},
+        {"amend-heavy",  "most commands amend resting orders",
+                {50,   0,   30, 65, 5,  50,   0.05, 0}},
+        {"sweep",        "large aggressive orders walk through many levels",
+                {4,    0,   85, 5,  5,  200,  0.05, 0.05}},
+};
+
+/**
+ * Samples symbol indexes with probability proportional to 1 / (rank + 1)^exponent
+ */
+class SymbolSampler {
+public:
+
+    SymbolSampler(size_t symbols_cnt, double exponent) {
+        double sum = 0;
+        for (size_t rank = 0; rank < symbols_cnt; ++rank) {
+            sum += 1 / std::pow(rank + 1, exponent);
+            cdf.push_back(sum);
+        }
+        for (double &value : cdf) {
+            value /= sum;
+        }
+    }
+
+    size_t sample(Random &random) const {
+        auto it = std::upper_bound(cdf.begin(), cdf.end(), random.real());
+        return std::min(size_t(it - cdf.begin()), cdf.size() - 1);
+    }
+
+private:
+
+    std::vector<double> cdf;
+};
+
+std::string formatPrice(int ticks) {
+    std::string cents = std::to_string(ticks % 100);
+    return std::to_string(ticks / 100) + (cents.size() == 1 ? ".0" : ".") + cents;
+}
+
+/**
+ * Generates csv command lines. Amends and pulls refer to orders which may still rest,
+ * pulled orders are forgotten, so cancel-heavy flow doesn't degrade into pulls of unknown orders
+ */
+std::vector<std::string> generate(FlowParams const &params, size_t count, uint64_t seed) {
+    Random random(seed);
+    SymbolSampler symbol_sampler(params.symbols_cnt, params.zipf_exponent);
+    int const mid_ticks = 10000;
+    double total_weight = params.insert_weight + params.amend_weight + params.pull_weight;
+
+    std::vector<std::string> lines;
+    lines.reserve(count);
+    std::vector<OrderId> live_ids;
+    OrderId next_id = 1;
+    auto randomPrice = [&](bool is_buy) {
+        int offset = 1 + int(random.below(params.spread_ticks));
+        bool is_crossing = random.real() < params.cross_probability;
+        return formatPrice(mid_ticks + ((is_buy != is_crossing) ? -offset : offset));
+    };
+
+    while (lines.size() < count) {
+        double choice = random.real() * total_weight;
+        if (live_ids.empty() || choice < params.insert_weight) {
+            OrderId id = next_id++;
+            bool is_buy = random.below(2) == 0;
+            std::string price = randomPrice(is_buy);
+            int volume = 1 + int(random.below(100));
+            if (random.real() < params.sweep_probability) {
+                int depth = 1 + int(random.below(params.spread_ticks));
+                price = formatPrice(mid_ticks + (is_buy ? depth : -depth));
+                volume *= 100;
+            }
+            lines.push_back("INSERT," + std::to_string(id) + ",S" + std::to_string(symbol_sampler.sample(random)) +
+                            (is_buy ? ",BUY," : ",SELL,") + price + "," + std::to_string(volume));
+            live_ids.push_back(id);
+        } else if (choice < params.insert_weight + params.amend_weight) {
+            OrderId id = live_ids[random.below(live_ids.size())];
+            lines.push_back("AMEND," + std::to_string(id) + "," + randomPrice(random.below(2) == 0) + "," +
+                            std::to_string(1 + random.below(100)));
+        } else {
+            size_t i = random.below(live_ids.size());
+            lines.push_back("PULL," + std::to_string(live_ids[i]));
+            live_ids[i] = live_ids.back();
+            live_ids.pop_back();
+        }
+    }
+    return lines;
+}
+
+/* measurements */
+
+/**
+ * Latencies of one kind of operation
+ */
+struct Samples {
+    std::string operation;
+    std::vector<uint64_t> latencies; // nanoseconds
+    size_t total_cnt = 0; // number of operations of the whole stage, zero if it's not measured separately
+    Clock::duration total{};
+
+    explicit Samples(std::string operation) : operation(std::move(operation)) {}
+
+    void add(Clock::duration duration) {
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+};
+
+void printHeader() {
+    std::cout << std::left << std::setw(14) << "scenario" << std::setw(16) << "operation" << std::right
+              << std::setw(10) << "count" << std::setw(14) << "ops/s" << std::setw(10) << "mean ns"
+              << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns" << std::setw(10) << "p99.9 ns"
+              << std::setw(12) << "max ns" << '\n';
+}
+
+/**
+ * Prints one row, throughput is taken from the stage time if it's known and from the sum of latencies otherwise
+ */
+void printSamples(char const *scenario, Samples &samples) {
+    std::vector<uint64_t> &latencies = samples.latencies;
+    if (latencies.empty() && samples.total_cnt == 0) {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t sum = 0;
+    for (uint64_t latency : latencies) {
+        sum += latency;
+    }
+    size_t count = samples.total_cnt != 0 ? samples.total_cnt : latencies.size();
+    double seconds = samples.total_cnt != 0 ? std::chrono::duration<double>(samples.total).count() : sum * 1e-9;
+    std::cout << std::left << std::setw(14) << scenario << std::setw(16) << samples.operation << std::right
+              << std::setw(10) << count << std::setw(14) << std::fixed << std::setprecision(0)
+              << (seconds > 0 ? count / seconds : 0);
+    if (latencies.empty()) {
+        std::cout << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-"
+                  << std::setw(12) << "-" << '\n';
+        return;
+    }
+    auto percentile = [&](double fraction) {
+        return latencies[std::min(latencies.size() - 1, size_t(fraction * latencies.size()))];
+    };
+    std::cout << std::setw(10) << sum / latencies.size() << std::setw(10) << percentile(0.5)
+              << std::setw(10) << percentile(0.99) << std::setw(10) << percentile(0.999)
+              << std::setw(12) << latencies.back() << '\n';
+}
+
+/**
+ * Engines over every book side storage, the same flow is run through each of the selected ones
+ */
+enum class Storage {
+    LADDER, TREE, HEAP
+};
+
+static std::pair<char const *, Storage> const STORAGES[] = {
+        {"ladder", Storage::LADDER},
+        {"tree",   Storage::TREE},
+        {"heap",   Storage::HEAP},
+};
+
+template<typename Engine>
+void runScenario(Scenario const &scenario, char const *storage_name, size_t count, uint64_t seed) {
+    std::vector<std::string> lines = generate(scenario.params, count, seed);
+
+    // parsing: throughput of the whole input, then latency of every line
+    Samples parse_samples("parse");
+    SymbolTable symbols = SymbolTable();
+    auto parse_start = Clock::now();
+    Commands commands = parseCommands(lines, symbols);
+    parse_samples.total = Clock::now() - parse_start;
+    parse_samples.total_cnt = lines.size();
+    {
+        SymbolTable line_symbols = SymbolTable();
+        Commands line_commands;
+        line_commands.reserve(lines.size());
+        for (std::string const &line : lines) {
+            auto start = Clock::now();
+            parseCommand(line, line_symbols, line_commands);
+            parse_samples.add(Clock::now() - start);
+        }
+    }
+
+    // matching: throughput of the whole batch
+    Samples match_samples("match");
+    {
+        TradeCollector trade_collector;
+        Engine engine(&trade_collector);
+        auto match_start = Clock::now();
+        engine.apply(commands);
+        match_samples.total = Clock::now() - match_start;
+        match_samples.total_cnt = commands.size();
+    }
+    Samples batch_samples("match-batch");
+    {
+        TradeCollector trade_collector;
+        Engine engine(&trade_collector);
+        auto match_start = Clock::now();
+        engine.applyBatch(commands);
+        batch_samples.total = Clock::now() - match_start;
+        batch_samples.total_cnt = commands.size();
+    }
+
+    // matching: latency of every command by its kind, order books are taken every 1% of the commands
+    Samples insert_samples("visitInsert"), amend_samples("visitAmend"), pull_samples("visitPull");
+    Samples books_samples("getOrderBooks"), format_samples("toString");
+    TradeCollector trade_collector;
+    Engine engine(&trade_collector);
+    size_t books_period = std::max<size_t>(1, commands.size() / 100);
+    for (size_t i = 0; i < commands.size(); ++i) {
+        Command const &command = commands[i];
+        auto start = Clock::now();
+        if (auto insert = std::get_if<Insert>(&command)) {
+            engine.visitInsert(*insert);
+            insert_samples.add(Clock::now() - start);
+        } else if (auto amend = std::get_if<Amend>(&command)) {
+            engine.visitAmend(*amend);
+            amend_samples.add(Clock::now() - start);
+        } else {
+            engine.visitPull(std::get<Pull>(command));
+            pull_samples.add(Clock::now() - start);
+        }
+        if ((i + 1) % books_period == 0) {
+            auto books_start = Clock::now();
+            std::vector<OrderBook> order_books = engine.getOrderBooks();
+            books_samples.add(Clock::now() - books_start);
+        }
+    }
+
+    // formatting of all trades and the final order books
+    std::vector<OrderBook> order_books = engine.getOrderBooks();
+    for (int i = 0; i < 10; ++i) {
+        auto start = Clock::now();
+        std::vector<std::string> output = toString(trade_collector.getTrades(), order_books, symbols);
+        format_samples.add(Clock::now() - start);
+    }
+
+    std::cout << "# " << scenario.name << ": " << scenario.description << ", " << storage_name << " storage, "
+              << commands.size() << " commands, "
+              << trade_collector.getTrades().size() << " trades, " << order_books.size() << " books\n";
+    for (Samples *samples : {&parse_samples, &match_samples, &batch_samples, &insert_samples, &amend_samples,
+                             &pull_samples, &books_samples, &format_samples}) {
+        printSamples(scenario.name, *samples);
+    }
+}
+
+static char const *const USAGE =
+        "usage: webbtraders-bench [--commands=<n>] [--seed=<n>] [--storage=<name>]... [<scenario>...]\n"
+        "  --commands  number of generated commands per scenario, 1000000 by default\n"
+        "  --seed      seed of the generators, 1 by default\n"
+        "  --storage   book side storage: ladder (default), tree or heap, several ones are run on the same flow\n"
+        "  scenarios: all by default, or some of uniform, zipf, deep-book, cancel-heavy, amend-heavy, sweep\n";
+
+int main(int argc, char **argv) {
+    size_t count = 1000000;
+    uint64_t seed = 1;
+    std::vector<Scenario const *> scenarios;
+    std::vector<std::pair<char const *, Storage> const *> storages;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto it = std::find_if(std::begin(SCENARIOS), std::end(SCENARIOS), [&](Scenario const &scenario) {
+            return arg == scenario.name;
+        });
+        try {
+            if (arg.rfind("--commands=", 0) == 0) {
+                count = std::stoull(arg.substr(11));
+            } else if (arg.rfind("--seed=", 0) == 0) {
+                seed = std::stoull(arg.substr(7));
+            } else if (arg.rfind("--storage=", 0) == 0) {
+                auto it_storage = std::find_if(std::begin(STORAGES), std::end(STORAGES), [&](auto const &storage) {
+                    return arg.substr(10) == storage.first;
+                });
+                if (it_storage == std::end(STORAGES)) {
+                    throw std::invalid_argument("unknown storage " + arg);
+                }
+                storages.push_back(&*it_storage);
+            } else if (it != std::end(SCENARIOS)) {
+                scenarios.push_back(&*it);
+            } else {
+                throw std::invalid_argument("unexpected argument " + arg);
+            }
+        } catch (std::logic_error const &e) {
+            std::cerr << "invalid argument " << arg << '\n' << USAGE;
+            return 2;
+        }
+    }
+    if (scenarios.empty()) {
+        for (Scenario const &scenario : SCENARIOS) {
+            scenarios.push_back(&scenario);
+        }
+    }
+
+    if (storages.empty()) {
+        storages.push_back(&STORAGES[0]);
+    }
+
+    printHeader();
+    for (Scenario const *scenario : scenarios) {
+        for (auto const *storage : storages) {
+            switch (storage->second) {
+                case Storage::LADDER:
+                    runScenario<BasicCLOBEngine<price_ladder>>(*scenario, storage->first, count, seed);
+                    break;
+                case Storage::TREE:
+                    runScenario<BasicCLOBEngine<price_tree>>(*scenario, storage->first, count, seed);
+                    break;
+                case Storage::HEAP:
+                    runScenario<BasicCLOBEngine<order_heap>>(*scenario, storage->first, count, seed);
+                    break;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "binary.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+/**
+ * Types of commands in records
+ */
+enum RecordType : uint8_t {
+    INSERT_RECORD = 0, AMEND_RECORD = 1, PULL_RECORD = 2
+};
+
+static size_t const HEADER_SIZE = 12;
+
+void encodeCommand(Command const &command, char *record) {
+    std::memset(record, 0, COMMAND_RECORD_SIZE);
+    if (auto insert = std::get_if<Insert>(&command)) {
+        record[0] = INSERT_RECORD;
+        record[1] = insert->side == Side::BUY ? 0 : 1;
+        storeLittleEndian<uint32_t>(record + 4, insert->symbol);
+        storeLittleEndian<int64_t>(record + 8, insert->order_id);
+        storeLittleEndian<int32_t>(record + 16, insert->price);
+        storeLittleEndian<int32_t>(record + 20, insert->volume);
+    } else if (auto amend = std::get_if<Amend>(&command)) {
+        record[0] = AMEND_RECORD;
+        storeLittleEndian<int64_t>(record + 8, amend->order_id);
+        storeLittleEndian<int32_t>(record + 16, amend->price);
+        storeLittleEndian<int32_t>(record + 20, amend->volume);
+    } else {
+        record[0] = PULL_RECORD;
+        storeLittleEndian<int64_t>(record + 8, std::get<Pull>(command).order_id);
+    }
+}
+
+Command decodeCommand(char const *record) {
+    auto order_id = loadLittleEndian<int64_t>(record + 8);
+    switch (static_cast<uint8_t>(record[0])) {
+        case INSERT_RECORD: {
+            if (record[1] != 0 && record[1] != 1) {
+                throw std::runtime_error("invalid insert record");
+            }
+            Side side = record[1] == 0 ? Side::BUY : Side::SELL;
+            return Insert(order_id, loadLittleEndian<uint32_t>(record + 4), side,
+                          loadLittleEndian<int32_t>(record + 16), loadLittleEndian<int32_t>(record + 20));
+        }
+        case AMEND_RECORD:
+            return Amend(order_id, loadLittleEndian<int32_t>(record + 16), loadLittleEndian<int32_t>(record + 20));
+        case PULL_RECORD:
+            return Pull(order_id);
+        default:
+            throw std::runtime_error("unknown command record");
+    }
+}
+
+bool isBinaryCommands(std::string_view data) {
+    return data.size() >= HEADER_SIZE &&
+           data.substr(0, sizeof(BINARY_COMMANDS_MAGIC)) ==
+           std::string_view(BINARY_COMMANDS_MAGIC, sizeof(BINARY_COMMANDS_MAGIC));
+}
+
+void encodeCommands(Commands const &commands, SymbolTable const &symbols, std::string &out) {
+    char buffer[COMMAND_RECORD_SIZE];
+
+    out.append(BINARY_COMMANDS_MAGIC, sizeof(BINARY_COMMANDS_MAGIC));
+    storeLittleEndian<uint32_t>(buffer, BINARY_COMMANDS_VERSION);
+    storeLittleEndian<uint32_t>(buffer + 4, static_cast<uint32_t>(symbols.size()));
+    out.append(buffer, 8);
+
+    for (SymbolId symbol = 0; symbol < symbols.size(); ++symbol) {
+        Symbol const &name = symbols.name(symbol);
+        storeLittleEndian<uint32_t>(buffer, static_cast<uint32_t>(name.size()));
+        out.append(buffer, 4);
+        out.append(name);
+    }
+
+    out.reserve(out.size() + commands.size() * COMMAND_RECORD_SIZE);
+    for (Command const &command : commands) {
+        encodeCommand(command, buffer);
+        out.append(buffer, COMMAND_RECORD_SIZE);
+    }
+}
+
+char const *ByteReader::take(size_t size) {
+    if (data.size() < size) {
+        throw std::runtime_error(std::string("truncated ") + what);
+    }
+    char const *begin = data.data();
+    data.remove_prefix(size);
+    return begin;
+}
+
+BinaryCommandReader::BinaryCommandReader(std::string_view data, SymbolTable &symbols) {
+    if (!isBinaryCommands(data) || loadLittleEndian<uint32_t>(data.data() + 4) != BINARY_COMMANDS_VERSION) {
+        throw std::runtime_error("invalid binary commands header");
+    }
+    auto symbols_cnt = loadLittleEndian<uint32_t>(data.data() + 8);
+    data.remove_prefix(HEADER_SIZE);
+
+    symbol_ids.reserve(symbols_cnt);
+    for (uint32_t i = 0; i < symbols_cnt; ++i) {
+        if (data.size() < 4) {
+            throw std::runtime_error("truncated binary commands symbols");
+        }
+        auto name_size = loadLittleEndian<uint32_t>(data.data());
+        data.remove_prefix(4);
+        if (data.size() < name_size) {
+            throw std::runtime_error("truncated binary commands symbols");
+        }
+        symbol_ids.push_back(symbols.intern(data.substr(0, name_size)));
+        data.remove_prefix(name_size);
+    }
+
+    if (data.size() % COMMAND_RECORD_SIZE != 0) {
+        throw std::runtime_error("truncated binary commands record");
+    }
+    records = data;
+}
+
+size_t BinaryCommandReader::read(Commands &commands, size_t max_cnt) {
+    size_t read_cnt = std::min(max_cnt, records.size() / COMMAND_RECORD_SIZE);
+    for (size_t i = 0; i < read_cnt; ++i) {
+        Command command = decodeCommand(records.data() + i * COMMAND_RECORD_SIZE);
+        if (auto insert = std::get_if<Insert>(&command)) {
+            if (insert->symbol >= symbol_ids.size()) {
+                throw std::runtime_error("unknown symbol in insert record");
+            }
+            insert->symbol = symbol_ids[insert->symbol];
+        }
+        commands.push_back(command);
+    }
+    records.remove_prefix(read_cnt * COMMAND_RECORD_SIZE);
+    return read_cnt;
+}
+
+bool BinaryCommandReader::empty() const {
+    return records.empty();
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "common.hpp"
+#include "symbols.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Binary commands format, all integers are little-endian:
+ * - header: magic "WBTC", u32 format version, u32 number of symbols
+ * - symbols in order of their identifiers: u32 name length, name bytes
+ * - commands, each in a record of {@see COMMAND_RECORD_SIZE} bytes:
+ *   u8 type (0 - insert, 1 - amend, 2 - pull), u8 side (0 - buy, 1 - sell), u16 zero, u32 symbol identifier,
+ *   i64 order_id, i32 shifted price, i32 volume.
+ *   Fields which the command doesn't have are zero.
+ */
+
+static char const BINARY_COMMANDS_MAGIC[4] = {'W', 'B', 'T', 'C'};
+static uint32_t const BINARY_COMMANDS_VERSION = 1;
+static size_t const COMMAND_RECORD_SIZE = 24;
+
+template<typename T>
+void storeLittleEndian(char *out, T value) {
+    static_assert(std::is_integral<T>::value, "only integers are stored");
+    auto bits = static_cast<typename std::make_unsigned<T>::type>(value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out[i] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+    }
+}
+
+template<typename T>
+T loadLittleEndian(char const *in) {
+    static_assert(std::is_integral<T>::value, "only integers are loaded");
+    typename std::make_unsigned<T>::type bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        bits |= static_cast<decltype(bits)>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return static_cast<T>(bits);
+}
+
+/**
+ * Appends the integer to `out` in little-endian byte order
+ */
+template<typename T>
+void appendLittleEndian(std::string &out, T value) {
+    char buffer[sizeof(T)];
+    storeLittleEndian<T>(buffer, value);
+    out.append(buffer, sizeof(T));
+}
+
+/**
+ * Reads little-endian integers and byte strings from a buffer one after another.
+ * Throws std::runtime_error naming `what` if the buffer ends before the requested value
+ */
+class ByteReader {
+public:
+
+    ByteReader(std::string_view data, char const *what) : data(data), what(what) {}
+
+    template<typename T>
+    T read() {
+        return loadLittleEndian<T>(take(sizeof(T)));
+    }
+
+    std::string_view readBytes(size_t size) {
+        return std::string_view(take(size), size);
+    }
+
+    /**
+     * Data which isn't read yet
+     */
+    std::string_view rest() const {
+        return data;
+    }
+
+private:
+
+    std::string_view data;
+    char const *what;
+
+    char const *take(size_t size);
+};
+
+/**
+ * Writes the command to `record`, which has room for {@see COMMAND_RECORD_SIZE} bytes
+ */
+void encodeCommand(Command const &command, char *record);
+
+/**
+ * Reads the command from the record, symbol identifier is taken as is.
+ * Throws std::runtime_error if the record is invalid
+ */
+Command decodeCommand(char const *record);
+
+/**
+ * `true` if the data starts with the binary commands header
+ */
+bool isBinaryCommands(std::string_view data);
+
+/**
+ * Appends the binary representation of the commands with all the symbols to `out`
+ */
+void encodeCommands(Commands const &commands, SymbolTable const &symbols, std::string &out);
+
+/**
+ * Reads commands in the binary format from a buffer, e.g. from a mapped file, without parsing text
+ */
+class BinaryCommandReader {
+public:
+
+    /**
+     * Reads the header, symbols of the data are interned into `symbols`.
+     * Throws std::runtime_error if the header is invalid
+     */
+    BinaryCommandReader(std::string_view data, SymbolTable &symbols);
+
+    /**
+     * Appends at most `max_cnt` next commands to `commands`. Returns number of appended commands
+     */
+    size_t read(Commands &commands, size_t max_cnt);
+
+    /**
+     * `true` if all the commands are read
+     */
+    bool empty() const;
+
+private:
+
+    std::string_view records;
+
+    /**
+     * Identifiers of the data's symbols in the caller's symbol table
+     */
+    std::vector<SymbolId> symbol_ids;
+};
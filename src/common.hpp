@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include <variant>
 
 /**
  * Type for order unique identifier
@@ -14,6 +15,11 @@ typedef int64_t OrderId;
  */
 typedef std::string Symbol;
 
+/**
+ * Type for interned symbol, index of the symbol name in {@see SymbolTable}
+ */
+typedef uint32_t SymbolId;
+
 /**
  * Type for order price
  */
@@ -31,6 +37,21 @@ enum Side {
     BUY, SELL
 };
 
+/**
+ * The other side of the book, the side orders of `side` trade with
+ */
+constexpr Side opposite(Side side) {
+    return side == Side::BUY ? Side::SELL : Side::BUY;
+}
+
+/**
+ * `true` if `lhs` price is more attractive than `rhs` for orders of the side
+ */
+template<Side side>
+constexpr bool isBetterPrice(Price lhs, Price rhs) {
+    return side == Side::BUY ? lhs > rhs : lhs < rhs;
+}
+
 /**
  * An insert pushes the order to the order book.
  * The order will be matched with the opposite side until either the volume of
@@ -63,54 +84,67 @@ struct CommandVisitor {
     virtual ~CommandVisitor() = default;
 };
 
-/**
- * Common interface for commands.
- * {@see Insert}
- * {@see Amend}
- * {@see Pull}
- */
-struct Command {
-    virtual void accept(CommandVisitor *visitor) const = 0;
-
-    virtual ~Command() = default;
-};
-
-struct Insert : Command {
+struct Insert {
     OrderId order_id;
-    Symbol symbol;
+    SymbolId symbol;
     Side side;
     Price price; // shifted price
     Volume volume;
 
-    Insert(OrderId order_id, Symbol symbol, Side side,
+    Insert(OrderId order_id, SymbolId symbol, Side side,
            Price price, Volume volume) : order_id(order_id),
-                                         symbol(std::move(symbol)),
+                                         symbol(symbol),
                                          side(side),
                                          price(price),
                                          volume(volume) {}
 
-    void accept(CommandVisitor *vistitor) const override { vistitor->visitInsert(*this); }
+    Insert() = default;
 };
 
-struct Amend : Command {
+struct Amend {
     OrderId order_id;
     Price price; // shifted price
     Volume volume;
 
     Amend(OrderId order_id, Price price, Volume volume) : order_id(order_id), price(price), volume(volume) {}
 
-    void accept(CommandVisitor *visitor) const override { visitor->visitAmend(*this); }
+    Amend() = default;
 };
 
-struct Pull : Command {
+struct Pull {
     OrderId order_id;
 
     explicit Pull(OrderId order_id) : order_id(order_id) {}
 
-    void accept(CommandVisitor *visitor) const override { visitor->visitPull(*this); }
-
+    Pull() = default;
 };
 
+/**
+ * Command stored by value, so batches of commands are kept contiguously.
+ * {@see Insert}
+ * {@see Amend}
+ * {@see Pull}
+ */
+typedef std::variant<Insert, Amend, Pull> Command;
+
+/**
+ * Commands in the order they are applied
+ */
+typedef std::vector<Command> Commands;
+
+/**
+ * Passes the command to the visitor's method for its type
+ */
+inline void accept(Command const &command, CommandVisitor *visitor) {
+    if (auto insert = std::get_if<Insert>(&command)) {
+        visitor->visitInsert(*insert);
+    } else if (auto amend = std::get_if<Amend>(&command)) {
+        visitor->visitAmend(*amend);
+    } else {
+        visitor->visitPull(std::get<Pull>(command));
+    }
+}
+
 struct OrderBook {
     struct Item {
         Price price;
@@ -119,23 +153,60 @@ struct OrderBook {
         Item(Price price, Volume volume) : price(price), volume(volume) {}
     };
 
-    Symbol symbol;
+    SymbolId symbol;
     std::vector<Item> bids;
     std::vector<Item> asks;
 
-    OrderBook(Symbol symbol, std::vector<Item> bids,
-              std::vector<Item> asks) : symbol(std::move(symbol)), bids(std::move(bids)), asks(std::move(asks)) {}
+    OrderBook(SymbolId symbol, std::vector<Item> bids,
+              std::vector<Item> asks) : symbol(symbol), bids(std::move(bids)), asks(std::move(asks)) {}
 };
 
 
 struct Trade {
-    Symbol symbol;
+    SymbolId symbol;
     Price price; // x10000
     Volume volume;
     OrderId aggressive_order_id;
     OrderId passive_order_id;
 
-    Trade(Symbol symbol, Price price, Volume volume, OrderId aggressive_order_id,
-          OrderId passive_order_id) : symbol(std::move(symbol)), price(price), volume(volume),
+    Trade() = default;
+
+    Trade(SymbolId symbol, Price price, Volume volume, OrderId aggressive_order_id,
+          OrderId passive_order_id) : symbol(symbol), price(price), volume(volume),
                                       aggressive_order_id(aggressive_order_id), passive_order_id(passive_order_id) {}
-};
\ No newline at end of file
+};
+
+/**
+ * Receives trades at the moment orders are matched
+ */
+struct TradeListener {
+    virtual void onTrade(Trade const &trade) = 0;
+
+    virtual ~TradeListener() = default;
+};
+
+/**
+ * New state of one price level of an order book
+ */
+struct LevelUpdate {
+    SymbolId symbol;
+    Side side;
+    Price price; // x10000
+    Volume volume; // total volume of the level's orders, 0 if the level is removed
+
+    LevelUpdate() = default;
+
+    LevelUpdate(SymbolId symbol, Side side, Price price, Volume volume) : symbol(symbol), side(side), price(price),
+                                                                          volume(volume) {}
+};
+
+/**
+ * Receives changes of price levels at the moment orders rest, change or leave the book.
+ * A trade is reported to {@see TradeListener} before the level update it causes,
+ * and a level which is hit by several fills of one order is reported once, after the last of them
+ */
+struct BookListener {
+    virtual void onLevelUpdate(LevelUpdate const &update) = 0;
+
+    virtual ~BookListener() = default;
+};
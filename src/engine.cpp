@@ -1,297 +1,574 @@
 #include "engine.hpp"
+#include "binary.hpp"
 
+#include <algorithm>
+#include <stdexcept>
 #include <vector>
-#include <unordered_map>
 
-/* push wrapper */
+/* snapshot helpers */
 
 /**
- * Create a queue if it's not exists and push order
+ * Smallest records of the engine snapshot, counts read from a snapshot are bounded by the remaining bytes
+ * divided by these sizes, so a corrupted count isn't taken for a huge allocation
  */
-template<typename Compare>
-void push(Queues<Compare> &queues, Symbol const &symbol, Order const &order);
-
-/* remove wrappers */
+static size_t const SNAPSHOT_ORDER_SIZE = 20; // i64 order identifier, i32 volume, u64 time
+static size_t const SNAPSHOT_LEVEL_SIZE = 8 + SNAPSHOT_ORDER_SIZE; // i32 price, u32 number of orders, an order
+static size_t const SNAPSHOT_BOOK_SIZE = 8; // u32 number of levels of both sides
 
 /**
- * Remove order from queue by order_id, erase queue if it becomes empty
+ * Reads a count of records and checks that so many of them fit into the rest of the data
  */
-template<typename Compare>
-void remove(Queues<Compare> &queues, Symbol const &symbol, OrderId order_id);
+template<typename T>
+T readCount(ByteReader &reader, size_t record_size) {
+    auto cnt = reader.read<T>();
+    if (cnt > reader.rest().size() / record_size) {
+        throw std::runtime_error("invalid count in engine snapshot");
+    }
+    return cnt;
+}
+
+/* order books helper */
 
 /**
- * Remove order from queue by iterator, erase queue if it becomes empty
+ * Formats order books, levels are listed from the best one
  */
-template<typename Compare>
-void remove(Queues<Compare> &queues, Symbol const &symbol, std::vector<Order>::iterator it_order);
+template<typename BookSide>
+std::vector<OrderBook::Item> formatItems(BookSide const &book_side) {
+    std::vector<OrderBook::Item> items = std::vector<OrderBook::Item>();
+    book_side.forEachLevel([&items](Price price, Volume volume) {
+        items.emplace_back(price, volume);
+        return true;
+    });
+    return items;
+}
 
-/* order books helper */
+/**
+ * Appends up to `depth` best levels of the book side to `items`, only the appended levels are visited
+ */
+template<typename BookSide>
+void formatTopItems(BookSide const &book_side, size_t depth, std::vector<OrderBook::Item> &items) {
+    size_t items_cnt = 0;
+    book_side.forEachLevel([depth, &items, &items_cnt](Price price, Volume volume) {
+        if (items_cnt == depth) {
+            return false;
+        }
+        items.emplace_back(price, volume);
+        return ++items_cnt < depth;
+    });
+}
 
 /**
- * Formats order books
+ * Total volume of levels with prices equal to or better than `price`
  */
-template<typename Compare>
-std::vector<OrderBook::Item> formatItems(Queue<Compare> queue);
+template<Side side, typename BookSide>
+int64_t volumeTo(BookSide const &book_side, Price price) {
+    int64_t volume = 0;
+    book_side.forEachLevel([price, &volume](Price level_price, Volume level_volume) {
+        if (isBetterPrice<side>(price, level_price)) {
+            return false;
+        }
+        volume += level_volume;
+        return true;
+    });
+    return volume;
+}
 
-/* CLOBEngine definition  */
+char const *latencyKindName(LatencyKind kind) {
+    switch (kind) {
+        case LatencyKind::INSERT_RESTING:
+            return "insert-resting";
+        case LatencyKind::INSERT_MATCHING:
+            return "insert-matching";
+        case LatencyKind::AMEND_IN_PLACE:
+            return "amend-in-place";
+        case LatencyKind::AMEND_REPRICE:
+            return "amend-reprice";
+        case LatencyKind::PULL:
+            return "pull";
+    }
+    return "";
+}
+
+/* TradeCollector definition */
+
+void TradeCollector::onTrade(Trade const &trade) {
+    trades.push_back(trade);
+}
 
-CLOBEngine::CLOBEngine() {
-    buys = std::unordered_map<Symbol, Queue<BuysComparator>>();
-    sells = std::unordered_map<Symbol, Queue<SellsComparator>>();
-    trades = std::vector<Trade>();
+std::vector<Trade> const &TradeCollector::getTrades() const {
+    return trades;
+}
 
-    order_infos = std::unordered_map<OrderId, OrderInfo>();
+/* BasicCLOBEngine definition  */
+
+template<template<Side> class BookSide>
+BasicCLOBEngine<BookSide>::BasicCLOBEngine(TradeListener *trade_listener, size_t orders_capacity,
+                                           BookListener *book_listener) : trade_listener(trade_listener),
+                                                                          book_listener(book_listener),
+                                                                          order_infos(orders_capacity) {
+    books = std::vector<Book>();
+    orders = OrderPool();
     cur_time = 0;
 }
 
-void CLOBEngine::visitInsert(Insert const &insert) {
-    if (order_infos.find(insert.order_id) != order_infos.end()) {
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::apply(Commands const &commands) {
+    for (Command const &command : commands) {
+        apply(command);
+    }
+}
+
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::apply(Command const &command) {
+    if (auto insert = std::get_if<Insert>(&command)) {
+        visitInsert(*insert);
+    } else if (auto amend = std::get_if<Amend>(&command)) {
+        visitAmend(*amend);
+    } else {
+        visitPull(std::get<Pull>(command));
+    }
+}
+
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::applyBatch(Commands const &commands) {
+    size_t const lookups_distance = PREFETCH_DISTANCE * 2;
+    for (size_t i = 0; i < std::min(lookups_distance, commands.size()); ++i) {
+        prefetchLookups(commands[i]);
+    }
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (i + lookups_distance < commands.size()) {
+            prefetchLookups(commands[i + lookups_distance]);
+        }
+        if (i + PREFETCH_DISTANCE < commands.size()) {
+            prefetchOrders(commands[i + PREFETCH_DISTANCE]);
+        }
+        apply(commands[i]);
+    }
+}
+
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::visitInsert(Insert const &insert) {
+    LatencyTimer timer;
+    if (!seen_ids.insert(insert.order_id)) {
         return; // already inserted
     }
-    order_infos.emplace(insert.order_id, OrderInfo(insert.symbol, insert.side));
+    if (insert.symbol >= books.size()) {
+        books.resize(insert.symbol + 1);
+    }
+    Book &book = books[insert.symbol];
     Order order(insert.order_id, insert.price, insert.volume, ++cur_time);
+    OrderHandle handle = NULL_POOL_HANDLE;
     switch (insert.side) {
         case Side::BUY:
-            insertImpl(buys, sells, insert.symbol, order, true);
+            handle = insertImpl<Side::BUY>(book, insert.symbol, order);
             break;
         case Side::SELL:
-            insertImpl(sells, buys, insert.symbol, order, false);
+            handle = insertImpl<Side::SELL>(book, insert.symbol, order);
             break;
     }
+    if (handle != NULL_POOL_HANDLE) {
+        order_infos.insert(insert.order_id, OrderInfo(insert.symbol, insert.side, handle));
+    }
+    recordLatency(order.volume == insert.volume ? LatencyKind::INSERT_RESTING : LatencyKind::INSERT_MATCHING, timer);
 }
 
-void CLOBEngine::visitAmend(Amend const &amend) {
-    auto it_info = order_infos.find(amend.order_id);
-    if (it_info == order_infos.end()) {
-        return;
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::visitAmend(Amend const &amend) {
+    LatencyTimer timer;
+    OrderInfo const *info_ptr = order_infos.find(amend.order_id);
+    if (info_ptr == nullptr) {
+        return; // unknown, filled or pulled
+    }
+    OrderInfo info = *info_ptr;
+    Book &book = books[info.symbol];
+    bool is_in_place = false;
+    switch (info.side) {
+        case Side::BUY:
+            is_in_place = amendImpl<Side::BUY>(book, info, amend);
+            break;
+        case Side::SELL:
+            is_in_place = amendImpl<Side::SELL>(book, info, amend);
+            break;
+    }
+    recordLatency(is_in_place ? LatencyKind::AMEND_IN_PLACE : LatencyKind::AMEND_REPRICE, timer);
+}
+
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::visitPull(Pull const &pull) {
+    LatencyTimer timer;
+    OrderInfo const *info_ptr = order_infos.find(pull.order_id);
+    if (info_ptr == nullptr) {
+        return; // unknown, filled or pulled
     }
-    Symbol symbol = it_info->second.symbol;
-    switch (it_info->second.side) {
+    OrderInfo info = *info_ptr;
+    Book &book = books[info.symbol];
+    Price price = orders[info.handle].price;
+    Volume level_volume = 0;
+    switch (info.side) {
         case Side::BUY:
-            amendImpl(buys, symbol, amend, true);
+            level_volume = pullImpl<Side::BUY>(book, info.handle);
             break;
-        case Side::SELL: {
-            amendImpl(sells, symbol, amend, false);
+        case Side::SELL:
+            level_volume = pullImpl<Side::SELL>(book, info.handle);
             break;
+    }
+    updateLevel(info.symbol, info.side, price, level_volume);
+    orders.free(info.handle);
+    order_infos.erase(pull.order_id);
+    recordLatency(LatencyKind::PULL, timer);
+}
+
+template<template<Side> class BookSide>
+std::vector<OrderBook> BasicCLOBEngine<BookSide>::getOrderBooks() {
+    std::vector<OrderBook> order_books;
+    for (SymbolId symbol = 0; symbol < books.size(); ++symbol) {
+        Book const &book = books[symbol];
+        if (book.bids.empty() && book.asks.empty()) {
+            continue;
         }
+        order_books.emplace_back(symbol, formatItems(book.bids), formatItems(book.asks));
     }
+    return order_books;
 }
 
-void CLOBEngine::visitPull(Pull const &pull) {
-    auto it_info = order_infos.find(pull.order_id);
-    if (it_info == order_infos.end()) {
+template<template<Side> class BookSide>
+BestBidOffer BasicCLOBEngine<BookSide>::getBestBidOffer(SymbolId symbol) const {
+    BestBidOffer best_bid_offer;
+    if (symbol >= books.size()) {
+        return best_bid_offer;
+    }
+    Book const &book = books[symbol];
+    if (!book.bids.empty()) {
+        auto [price, volume] = book.bids.bestLevel();
+        best_bid_offer.bid = OrderBook::Item(price, volume);
+    }
+    if (!book.asks.empty()) {
+        auto [price, volume] = book.asks.bestLevel();
+        best_bid_offer.ask = OrderBook::Item(price, volume);
+    }
+    return best_bid_offer;
+}
+
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::getTopLevels(SymbolId symbol, Side side, size_t depth,
+                                             std::vector<OrderBook::Item> &levels) const {
+    levels.clear();
+    if (symbol >= books.size()) {
         return;
     }
-    Symbol symbol = it_info->second.symbol;
-    switch (it_info->second.side) {
+    switch (side) {
         case Side::BUY:
-            remove(buys, symbol, pull.order_id);
+            formatTopItems(books[symbol].bids, depth, levels);
             break;
         case Side::SELL:
-            remove(sells, symbol, pull.order_id);
+            formatTopItems(books[symbol].asks, depth, levels);
             break;
     }
 }
 
-std::vector<OrderBook> CLOBEngine::getOrderBooks() {
-    std::vector<Symbol> symbols;
-    symbols.reserve(buys.size() + sells.size());
+template<template<Side> class BookSide>
+int64_t BasicCLOBEngine<BookSide>::getVolumeTo(SymbolId symbol, Side side, Price price) const {
+    if (symbol >= books.size()) {
+        return 0;
+    }
+    switch (side) {
+        case Side::BUY:
+            return volumeTo<Side::BUY>(books[symbol].bids, price);
+        case Side::SELL:
+            return volumeTo<Side::SELL>(books[symbol].asks, price);
+    }
+    return 0;
+}
+
+template<template<Side> class BookSide>
+bool BasicCLOBEngine<BookSide>::hasOrder(OrderId order_id) const {
+    return order_infos.find(order_id) != nullptr;
+}
+
+template<template<Side> class BookSide>
+LatencyHistogram const &BasicCLOBEngine<BookSide>::latencyHistogram(LatencyKind kind) const {
+    return latency_histograms[static_cast<size_t>(kind)];
+}
+
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::writeSnapshot(std::string &out) const {
+    appendLittleEndian<uint64_t>(out, cur_time);
+    appendLittleEndian<uint64_t>(out, order_infos.size());
+    appendLittleEndian<uint32_t>(out, static_cast<uint32_t>(books.size()));
+    for (Book const &book : books) {
+        writeSide(book.bids, out);
+        writeSide(book.asks, out);
+    }
+    seen_ids.writeSnapshot(out);
+}
 
-    for (auto const &it_queue_buy : buys) {
-        symbols.push_back(it_queue_buy.first);
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::restoreSnapshot(std::string_view data) {
+    if (cur_time != 0 || seen_ids.pagesCount() != 0) {
+        throw std::runtime_error("snapshot can only be restored to a new engine");
+    }
+    ByteReader reader(data, "engine snapshot");
+    cur_time = reader.read<uint64_t>();
+    auto orders_cnt = readCount<uint64_t>(reader, SNAPSHOT_ORDER_SIZE);
+    order_infos.reserve(orders_cnt);
+    books.resize(readCount<uint32_t>(reader, SNAPSHOT_BOOK_SIZE));
+    for (SymbolId symbol = 0; symbol < books.size(); ++symbol) {
+        restoreSide(reader, books[symbol].bids, symbol);
+        restoreSide(reader, books[symbol].asks, symbol);
+    }
+    if (order_infos.size() != orders_cnt) {
+        throw std::runtime_error("number of resting orders doesn't match engine snapshot");
+    }
+    seen_ids.restoreSnapshot(reader);
+    bool is_seen = true;
+    order_infos.forEach([this, &is_seen](OrderId order_id, OrderInfo const &) {
+        is_seen = is_seen && seen_ids.contains(order_id);
+    });
+    if (!is_seen) {
+        throw std::runtime_error("resting order isn't registered in engine snapshot");
     }
-    for (auto const &it_queue_sell : sells) {
-        symbols.push_back(it_queue_sell.first);
+    if (!reader.rest().empty()) {
+        throw std::runtime_error("unexpected data after engine snapshot");
     }
+}
 
-    std::sort(symbols.begin(), symbols.end());
-    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+/* BasicCLOBEngine implementation details */
 
-    std::vector<OrderBook> order_books;
-    order_books.reserve(symbols.size());
+template<template<Side> class BookSide>
+template<Side side>
+BookSide<side> &BasicCLOBEngine<BookSide>::Book::sideOf() {
+    if constexpr (side == Side::BUY) {
+        return bids;
+    } else {
+        return asks;
+    }
+}
+
+template<template<Side> class BookSide>
+template<Side side>
+BookSide<side> const &BasicCLOBEngine<BookSide>::Book::sideOf() const {
+    if constexpr (side == Side::BUY) {
+        return bids;
+    } else {
+        return asks;
+    }
+}
 
-    for (Symbol const &symbol : symbols) {
-        std::vector<OrderBook::Item> items_bids, items_asks;
-        auto it_buys = buys.find(symbol);
-        if (it_buys != buys.end()) {
-            items_bids = formatItems(it_buys->second);
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::prefetchLookups(Command const &command) const {
+    if (auto insert = std::get_if<Insert>(&command)) {
+        order_infos.prefetch(insert->order_id);
+        if (insert->symbol < books.size()) {
+            __builtin_prefetch(&books[insert->symbol]);
         }
-        auto it_sells = sells.find(symbol);
-        if (it_sells != sells.end()) {
-            items_asks = formatItems(it_sells->second);
+    } else if (auto amend = std::get_if<Amend>(&command)) {
+        order_infos.prefetch(amend->order_id);
+    } else {
+        order_infos.prefetch(std::get<Pull>(command).order_id);
+    }
+}
+
+/**
+ * Orders may be filled or pulled before the command is applied, prefetching of a released slot is harmless
+ */
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::prefetchOrders(Command const &command) const {
+    OrderInfo const *info = nullptr;
+    if (auto insert = std::get_if<Insert>(&command)) {
+        if (insert->symbol < books.size()) {
+            Book const &book = books[insert->symbol];
+            if (insert->side == Side::BUY && !book.asks.empty()) {
+                orders.prefetch(book.asks.top());
+            } else if (insert->side == Side::SELL && !book.bids.empty()) {
+                orders.prefetch(book.bids.top());
+            }
         }
-        order_books.emplace_back(symbol, items_bids, items_asks);
+        return;
+    } else if (auto amend = std::get_if<Amend>(&command)) {
+        info = order_infos.find(amend->order_id);
+    } else {
+        info = order_infos.find(std::get<Pull>(command).order_id);
+    }
+    if (info != nullptr) {
+        orders.prefetch(info->handle);
     }
-    return order_books;
 }
 
-std::vector<Trade> CLOBEngine::getTrades() {
-    return trades;
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::recordLatency(LatencyKind kind, LatencyTimer const &timer) {
+    if (LatencyTimer::ENABLED) {
+        latency_histograms[static_cast<size_t>(kind)].record(timer.elapsed());
+    }
 }
 
-/* CLOBEngine implementation details */
-
-template<typename CompareAggressive, typename ComparePassive>
-void CLOBEngine::insertImpl(
-        Queues<CompareAggressive> &aggressive_queues,
-        Queues<ComparePassive> &passive_queues,
-        Symbol symbol,
-        Order &aggressive_order,
-        bool is_buy
-) {
-    // check for passive orders queue
-    auto it_passive_queue = passive_queues.find(symbol);
-    // if there are no passive orders, push order to queue
-    if (it_passive_queue == passive_queues.end()) {
-        push(aggressive_queues, symbol, aggressive_order);
-        return;
+template<template<Side> class BookSide>
+template<Side side>
+OrderHandle BasicCLOBEngine<BookSide>::insertImpl(Book &book, SymbolId symbol, Order &aggressive_order) {
+    constexpr Side passive_side = opposite(side);
+    BookSide<side> &aggressive_side = book.template sideOf<side>();
+    BookSide<passive_side> &passive_book_side = book.template sideOf<passive_side>();
+
+    // if there are no passive orders, push order to the book
+    if (passive_book_side.empty()) {
+        return rest(aggressive_side, symbol, aggressive_order);
     }
-    Queue<ComparePassive> &passive_queue = it_passive_queue->second;
 
     // if volume is 0 then order is either invalid or already matched
     while (aggressive_order.volume > 0) {
-        // if there are no passive orders left, cleanup and push order to queue
-        if (passive_queue.empty()) {
-            passive_queues.erase(it_passive_queue);
-            push(aggressive_queues, symbol, aggressive_order);
-            return;
+        // if there are no passive orders left, push order to the book
+        if (passive_book_side.empty()) {
+            return rest(aggressive_side, symbol, aggressive_order);
         }
 
-        // unsafe access by reference useful if want just update it's volume
-        Order &best_passive_order = passive_queue.top();
+        OrderHandle best_passive_handle = passive_book_side.top();
+        Order const &best_passive_order = orders[best_passive_handle];
 
-        // orders matched if buy price is lower or equal than sell price
-        bool is_match = (is_buy && best_passive_order.price <= aggressive_order.price) ||
-                        (!is_buy && aggressive_order.price <= best_passive_order.price);
-        // if there is no match, push order to queue
-        if (!is_match) {
-            push(aggressive_queues, symbol, aggressive_order);
-            return;
+        // orders don't match if the passive price is beyond the aggressive order's limit
+        if (isBetterPrice<side>(best_passive_order.price, aggressive_order.price)) {
+            return rest(aggressive_side, symbol, aggressive_order);
         }
 
-        // if there is a match, save a trade
+        // if there is a match, report a trade
+        OrderId passive_order_id = best_passive_order.order_id;
         Price price = best_passive_order.price;
         Volume volume = std::min(best_passive_order.volume, aggressive_order.volume);
-        trades.emplace_back(symbol, price, volume, aggressive_order.order_id, best_passive_order.order_id);
+        bool is_passive_filled = volume == best_passive_order.volume;
+        if (trade_listener != nullptr) {
+            trade_listener->onTrade(Trade(symbol, price, volume, aggressive_order.order_id, passive_order_id));
+        }
 
-        // update orders volume
-        best_passive_order.volume -= volume;
+        // update orders volume, current best passive order is dropped if it's filled
         aggressive_order.volume -= volume;
-
-        // drop current best passive order if need
-        if (best_passive_order.volume == 0) {
-            passive_queue.pop();
+        Volume level_volume = passive_book_side.fillTop(orders, volume);
+        if (is_passive_filled) {
+            order_infos.erase(passive_order_id);
+            orders.free(best_passive_handle);
+        }
+        // the level is reported once the aggressive order is done with it
+        if (level_volume == 0 || aggressive_order.volume == 0) {
+            updateLevel(symbol, passive_side, price, level_volume);
         }
     }
-    // cleanup
-    if (passive_queue.empty()) {
-        passive_queues.erase(it_passive_queue);
-    }
+    return NULL_POOL_HANDLE;
 }
 
-
-template<typename Compare>
-void CLOBEngine::amendImpl(Queues<Compare> &queues, Symbol const &symbol, Amend amend, bool is_buy) {
-    auto it_queue = queues.find(symbol);
-    if (it_queue == queues.end()) {
-        // mustn't happen
-        return;
-    }
-    auto it_order = it_queue->second.find(amend.order_id);
-    if (it_order == it_queue->second.end()) {
-        // unknown order_id passed
-        return;
-    }
+template<template<Side> class BookSide>
+template<Side side>
+bool BasicCLOBEngine<BookSide>::amendImpl(Book &book, OrderInfo info, Amend amend) {
+    BookSide<side> &book_side = book.template sideOf<side>();
+    Order const &resting_order = orders[info.handle];
 
     // order doesn't lose time priority if the only change is the volume decrease
-    if (it_order->price == amend.price && it_order->volume > amend.volume) {
-        *it_order = Order(it_order->order_id, it_order->price, amend.volume, it_order->time);
-        return;
+    if (resting_order.price == amend.price && resting_order.volume > amend.volume) {
+        updateLevel(info.symbol, side, resting_order.price, book_side.setVolume(orders, info.handle, amend.volume));
+        return true;
     }
 
     // if there are any other changes amend is equal to insert
-    remove(queues, symbol, it_order);
+    updateLevel(info.symbol, side, resting_order.price, book_side.remove(orders, info.handle));
+    orders.free(info.handle);
     Order order = Order(amend.order_id, amend.price, amend.volume, ++cur_time);
-    if (is_buy) {
-        insertImpl(buys, sells, symbol, order, is_buy);
+    // matching erases entries of filled orders and moves other entries, so the order's entry is looked up again
+    OrderHandle handle = insertImpl<side>(book, info.symbol, order);
+    if (handle == NULL_POOL_HANDLE) {
+        order_infos.erase(amend.order_id);
     } else {
-        insertImpl(sells, buys, symbol, order, is_buy);
+        order_infos.find(amend.order_id)->handle = handle;
     }
+    return false;
 }
 
-/* push wrapper implementation */
-
-template<typename Compare>
-void push(Queues<Compare> &queues, Symbol const &symbol, Order const &order) {
-    auto it_queue = queues.find(symbol);
-    if (it_queue == queues.end()) {
-        auto queue = Queue<Compare>([](const Order &order) { return order.order_id; });
-        queue.push(order);
-        queues.insert({symbol, queue});
-    } else {
-        it_queue->second.push(order);
-    }
+template<template<Side> class BookSide>
+template<Side side>
+Volume BasicCLOBEngine<BookSide>::pullImpl(Book &book, OrderHandle handle) {
+    return book.template sideOf<side>().remove(orders, handle);
 }
 
-/* remove wrappers implementation */
-
-template<typename Compare>
-void remove(Queues<Compare> &queues, typename Queues<Compare>::iterator it_queue,
-            std::vector<Order>::iterator it_order) {
-    // remove order from queue
-    it_queue->second.remove(it_order);
-    // if no orders left in this queue, remove it
-    if (it_queue->second.empty()) {
-        queues.erase(it_queue);
-    }
+template<template<Side> class BookSide>
+template<Side side>
+OrderHandle BasicCLOBEngine<BookSide>::rest(BookSide<side> &book_side, SymbolId symbol, Order const &order) {
+    OrderHandle handle = orders.allocate(order);
+    updateLevel(symbol, side, order.price, book_side.push(orders, handle));
+    return handle;
 }
 
-template<typename Compare>
-void remove(Queues<Compare> &queues, Symbol const &symbol, OrderId order_id) {
-    auto it_queue = queues.find(symbol);
-    if (it_queue == queues.end()) {
-        return;
-    }
-    auto it_order = it_queue->second.find(order_id);
-    if (it_order != it_queue->second.end()) {
-        remove(queues, it_queue, it_order);
+template<template<Side> class BookSide>
+void BasicCLOBEngine<BookSide>::updateLevel(SymbolId symbol, Side side, Price price, Volume volume) {
+    if (book_listener != nullptr) {
+        book_listener->onLevelUpdate(LevelUpdate(symbol, side, price, volume));
     }
 }
 
-template<typename Compare>
-void remove(Queues<Compare> &queues, Symbol const &symbol, std::vector<Order>::iterator it_order) {
-    auto it_queue = queues.find(symbol);
-    if (it_queue == queues.end()) {
-        // mustn't happen because of client's code checks
-        return;
+/**
+ * Levels from the best to the worst: i32 price, u32 number of orders, then orders in FIFO order:
+ * i64 order_id, i32 volume, u64 time
+ */
+template<template<Side> class BookSide>
+template<Side side>
+void BasicCLOBEngine<BookSide>::writeSide(BookSide<side> const &book_side, std::string &out) const {
+    uint32_t levels_cnt = 0;
+    book_side.forEachLevel([&levels_cnt](Price, Volume) {
+        ++levels_cnt;
+        return true;
+    });
+    appendLittleEndian<uint32_t>(out, levels_cnt);
+
+    // number of orders is only known when the level is over, so it's patched then
+    size_t orders_cnt_offset = 0;
+    uint32_t orders_cnt = 0;
+    bool is_first = true;
+    Price level_price = 0;
+    book_side.forEachOrder(orders, [&](Order const &order) {
+        if (is_first || order.price != level_price) {
+            if (!is_first) {
+                storeLittleEndian<uint32_t>(&out[orders_cnt_offset], orders_cnt);
+            }
+            is_first = false;
+            level_price = order.price;
+            orders_cnt = 0;
+            appendLittleEndian<int32_t>(out, order.price);
+            orders_cnt_offset = out.size();
+            appendLittleEndian<uint32_t>(out, 0);
+        }
+        ++orders_cnt;
+        appendLittleEndian<int64_t>(out, order.order_id);
+        appendLittleEndian<int32_t>(out, order.volume);
+        appendLittleEndian<uint64_t>(out, order.time);
+    });
+    if (!is_first) {
+        storeLittleEndian<uint32_t>(&out[orders_cnt_offset], orders_cnt);
     }
-    remove(queues, it_queue, it_order);
 }
 
 /**
- * Queue is copied because method removes it's elements (heap sort)
+ * Orders come in FIFO order, so every order is appended to the end of its level.
+ * Levels come from the best to the worst, anything else is a corrupted snapshot
  */
-template<typename Compare>
-std::vector<OrderBook::Item> formatItems(Queue<Compare> queue) {
-    std::vector<OrderBook::Item> items = std::vector<OrderBook::Item>();
-    if (queue.empty()) {
-        return items;
-    }
-    Order order = queue.top();
-    queue.pop();
-    Price cur_price = order.price;
-    Volume cur_volume = order.volume;
-    while (!queue.empty()) {
-        order = queue.top();
-        queue.pop();
-        if (order.price == cur_price) {
-            cur_volume += order.volume;
-        } else {
-            items.emplace_back(cur_price, cur_volume);
-            cur_price = order.price;
-            cur_volume = order.volume;
+template<template<Side> class BookSide>
+template<Side side>
+void BasicCLOBEngine<BookSide>::restoreSide(ByteReader &reader, BookSide<side> &book_side, SymbolId symbol) {
+    auto levels_cnt = readCount<uint32_t>(reader, SNAPSHOT_LEVEL_SIZE);
+    Price previous_price = 0;
+    for (uint32_t i = 0; i < levels_cnt; ++i) {
+        auto price = reader.read<int32_t>();
+        auto orders_cnt = readCount<uint32_t>(reader, SNAPSHOT_ORDER_SIZE);
+        if (orders_cnt == 0 || (i != 0 && !isBetterPrice<side>(previous_price, price))) {
+            throw std::runtime_error("invalid price level in engine snapshot");
+        }
+        previous_price = price;
+        for (uint32_t j = 0; j < orders_cnt; ++j) {
+            auto order_id = reader.read<int64_t>();
+            auto volume = reader.read<int32_t>();
+            auto time = reader.read<uint64_t>();
+            OrderHandle handle = orders.allocate(Order(order_id, price, volume, time));
+            book_side.push(orders, handle);
+            if (!order_infos.insert(order_id, OrderInfo(symbol, side, handle)).second) {
+                throw std::runtime_error("duplicate order in engine snapshot");
+            }
         }
     }
-    items.emplace_back(cur_price, cur_volume);
-    return items;
-}
\ No newline at end of file
+}
+
+template class BasicCLOBEngine<price_ladder>;
+template class BasicCLOBEngine<price_tree>;
+template class BasicCLOBEngine<order_heap>;
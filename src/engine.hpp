@@ -1,54 +1,136 @@
 #pragma once
 
 #include "common.hpp"
-#include "queue.hpp"
+#include "ladder.hpp"
+#include "tree.hpp"
+#include "heap.hpp"
+#include "flat_hash_map.hpp"
+#include "histogram.hpp"
+#include "id_set.hpp"
 
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <utility>
-#include <unordered_map>
 #include <vector>
 
-struct Order {
-    OrderId order_id;
-    Price price; // shifted price
-    Volume volume;
-    uint64_t time;
-
-    Order(OrderId order_id, Price price, Volume volume,
-          uint64_t time) : order_id(order_id), price(price), volume(volume), time(time) {}
-};
+class ByteReader;
 
+/**
+ * Location of a resting order, it's dropped once the order is filled or pulled
+ */
 struct OrderInfo {
-    Symbol symbol;
+    SymbolId symbol;
     Side side;
+    OrderHandle handle;
 
-    OrderInfo(Symbol symbol, Side side) : symbol(std::move(symbol)), side(side) {}
-};
+    OrderInfo() = default;
 
-template<typename Compare>
-using Queue = priority_queue<OrderId, Order, Compare>;
+    OrderInfo(SymbolId symbol, Side side, OrderHandle handle) : symbol(symbol), side(side), handle(handle) {}
+};
 
-template<typename Compare>
-using Queues = std::unordered_map<std::string, Queue<Compare>>;
+/**
+ * Best levels of both sides of a book, a side is empty if there are no orders on it
+ */
+struct BestBidOffer {
+    std::optional<OrderBook::Item> bid;
+    std::optional<OrderBook::Item> ask;
+};
 
-struct BuysComparator {
-    bool operator()(Order const &lhs, Order const &rhs) const {
-        return lhs.price != rhs.price ? lhs.price > rhs.price : lhs.time < rhs.time;
-    }
+/**
+ * Kinds of commands whose latencies are tracked separately
+ */
+enum class LatencyKind {
+    INSERT_RESTING, // insert which didn't trade
+    INSERT_MATCHING, // insert which traded, possibly through several levels
+    AMEND_IN_PLACE, // amend which only decreased the volume
+    AMEND_REPRICE, // amend which was executed as a new insert
+    PULL
 };
 
-struct SellsComparator {
-    bool operator()(Order const &lhs, Order const &rhs) const {
-        return lhs.price != rhs.price ? lhs.price < rhs.price : lhs.time < rhs.time;
-    }
+static size_t const LATENCY_KINDS_CNT = 5;
+
+/**
+ * Name of the kind for reports
+ */
+char const *latencyKindName(LatencyKind kind);
+
+/**
+ * Trade listener which keeps all trades
+ */
+class TradeCollector : public TradeListener {
+public:
+
+    void onTrade(Trade const &trade) override;
+
+    /**
+     * Returns all trades in chronological order
+     */
+    std::vector<Trade> const &getTrades() const;
+
+private:
+
+    std::vector<Trade> trades;
 };
 
 /**
- *  Central limit order book (CLOB) for managing orders
+ *  Central limit order book (CLOB) for managing orders.
+ *  Sides of the books are stored in `BookSide<Side::BUY>` and `BookSide<Side::SELL>`, so the storage is chosen
+ *  at compile time and the side of every book operation is known statically. A book side storage keeps
+ *  resting orders of one side, which live in the engine's {@see OrderPool} and are referred by handles,
+ *  and provides:
+ *   - `Volume push(OrderPool &, OrderHandle)` - puts the order behind the orders with the same price
+ *   - `OrderHandle top() const` - the oldest order with the best price, the side mustn't be empty
+ *   - `std::pair<Price, Volume> bestLevel() const` - the best level's price and total volume, the side mustn't be empty
+ *   - `Volume fillTop(OrderPool &, Volume)` - decreases the volume of the top order, drops it if nothing is left
+ *   - `Volume setVolume(OrderPool &, OrderHandle, Volume)` - changes the volume keeping the time priority
+ *   - `Volume remove(OrderPool &, OrderHandle)` - drops the order
+ *   - `bool empty() const`
+ *   - `void forEachLevel(F)` - `bool f(Price, Volume)` for levels from the best one while `f` returns `true`
+ *   - `void forEachOrder(OrderPool const &, F)` - `f(Order const &)` for orders from the best one
+ *  Modifying operations return the new total volume of the affected level, 0 if the level is dropped.
+ *  Dropped orders are only unlinked, their slots are released by the engine.
+ *  The engine is compiled for {@see price_ladder}, {@see price_tree} and {@see order_heap}. Complexities of the
+ *  operations differ between the storages and are documented on them, e.g. `forEachLevel` visits levels one by one
+ *  on the ladder and the tree, while the heap has to collect all its levels first, so depth queries are cheaper
+ *  on the former
  */
-class CLOBEngine : public CommandVisitor {
+template<template<Side> class BookSide>
+class BasicCLOBEngine final : public CommandVisitor {
 public:
 
-    CLOBEngine();
+    /**
+     * @param trade_listener - receives trades as soon as they happen, trades are dropped if it's `nullptr`
+     * @param orders_capacity - number of resting orders which can be registered before order lookup table grows
+     * @param book_listener - receives changes of price levels as soon as they happen, if it isn't `nullptr`
+     */
+    explicit BasicCLOBEngine(TradeListener *trade_listener = nullptr, size_t orders_capacity = 1 << 16,
+                             BookListener *book_listener = nullptr);
+
+    /**
+     * Applies commands in their order. Commands are dispatched statically, the visitor methods are kept
+     * for callers which use {@see CommandVisitor}
+     */
+    void apply(Commands const &commands);
+
+    /**
+     * Applies one command {@see apply(Commands const &)}
+     */
+    void apply(Command const &command);
+
+    /**
+     * Applies commands in their order like {@see apply(Commands const &)} does, with the same results.
+     * While a command is applied, memory of the following ones is prefetched: slots of their order lookups
+     * `PREFETCH_DISTANCE * 2` commands ahead, then their resting orders `PREFETCH_DISTANCE` commands ahead,
+     * so cache misses of consecutive amends and pulls overlap instead of following one another
+     */
+    void applyBatch(Commands const &commands);
+
+    /**
+     * Number of commands between prefetching of the command's memory and its use {@see applyBatch}
+     */
+    static constexpr size_t PREFETCH_DISTANCE = 8;
 
     /**
      * Inserts order to the order book
@@ -66,48 +148,171 @@ public:
     void visitPull(Pull const &pull) override;
 
     /**
-     * Returns all trades
+     * Returns current non-empty order books ordered by symbol identifier
      */
-    std::vector<Trade> getTrades();
+    std::vector<OrderBook> getOrderBooks();
 
     /**
-     * Returns current order books
+     * Returns the best bid and ask levels of the symbol
+     * O(1) time complexity, expected for {@see order_heap}
      */
-    std::vector<OrderBook> getOrderBooks();
+    BestBidOffer getBestBidOffer(SymbolId symbol) const;
+
+    /**
+     * Replaces the content of `levels` with up to `depth` best levels of the side, from the best one.
+     * The vector is reused, so repeated queries don't allocate
+     * O(depth) time complexity, O(levels + depth * log(levels)) for {@see order_heap}
+     */
+    void getTopLevels(SymbolId symbol, Side side, size_t depth, std::vector<OrderBook::Item> &levels) const;
+
+    /**
+     * Returns total volume of the side's levels with prices equal to or better than `price`,
+     * i.e. the volume an aggressive order limited by `price` could take
+     * O(levels with such prices) time complexity, O(levels + levels with such prices * log(levels))
+     * for {@see order_heap}
+     */
+    int64_t getVolumeTo(SymbolId symbol, Side side, Price price) const;
+
+    /**
+     * `true` if the order rests in a book, `false` if it's unknown, filled or pulled
+     * O(1) expected time complexity
+     */
+    bool hasOrder(OrderId order_id) const;
+
+    /**
+     * Latencies of applied commands of the kind. Commands which don't change anything (duplicate inserts,
+     * amends and pulls of unknown or finished orders) aren't recorded.
+     * Latencies are only recorded if the engine is compiled with WEBBTRADERS_LATENCY_STATS, histograms are empty
+     * otherwise
+     */
+    LatencyHistogram const &latencyHistogram(LatencyKind kind) const;
+
+    /**
+     * Appends the state of the books to `out`: resting orders level by level in their time priority,
+     * identifiers of all inserted orders and the time counter. Symbols are referred by identifiers,
+     * {@see writeSnapshot(CLOBEngine const &, SymbolTable const &, std::string &)} stores them with names.
+     * Snapshots don't depend on the book side storage
+     */
+    void writeSnapshot(std::string &out) const;
+
+    /**
+     * Restores the state written by {@see writeSnapshot} in one pass over `data`, e.g. over a mapped file.
+     * The engine must be new, it behaves like the engine which wrote the snapshot then.
+     * Throws std::runtime_error if the snapshot is invalid
+     */
+    void restoreSnapshot(std::string_view data);
 
 private:
+
+    /**
+     * Both sides of the symbol's order book
+     */
+    struct Book {
+        BookSide<Side::BUY> bids;
+        BookSide<Side::SELL> asks;
+
+        template<Side side>
+        BookSide<side> &sideOf();
+
+        template<Side side>
+        BookSide<side> const &sideOf() const;
+    };
+
     /**
      * Incremental counter, which value is passed to order to define priority among orders with equal price
      */
     uint64_t cur_time;
 
     /**
-     * Orders from the side {@see Side::BUY}
+     * Order books indexed by symbol identifier
      */
-    Queues<BuysComparator> buys;
+    std::vector<Book> books;
 
     /**
-     * Orders from the side {@see Side::SELL}
+     * Storage of resting orders, books link them by handles
      */
-    Queues<SellsComparator> sells;
+    OrderPool orders;
 
     /**
-     * Trades between orders
+     * Receiver of trades between orders, not owned
      */
-    std::vector<Trade> trades;
+    TradeListener *trade_listener;
+
+    /**
+     * Receiver of level changes, not owned
+     */
+    BookListener *book_listener;
+
+    /**
+     * Meta information about resting orders. There is no need to store the whole information in books.
+     * Entries are erased when orders are filled or pulled, so the table only grows with open orders
+     */
+    flat_hash_map<OrderId, OrderInfo> order_infos;
+
+    /**
+     * Identifiers of all inserted orders, used to prevent duplicates (e.g. two orders with the same order_id
+     * from distinct sides, pull and insert of orders with same order_id) at a bit per order
+     */
+    OrderIdSet seen_ids;
+
+    std::array<LatencyHistogram, LATENCY_KINDS_CNT> latency_histograms;
 
     /**
-     * Meta information about orders. There is no need to store the whole information in queues.
-     * Also used to prevent duplicates (e.g. two orders with the same order_id from distinct sides, pull and insert
-     * of orders with same order_id)
+     * Prefetches the command's slot in order lookup table and its book
      */
-    std::unordered_map<OrderId, OrderInfo> order_infos;
+    void prefetchLookups(Command const &command) const;
 
-    template<typename CompareAggressive, typename ComparePassive>
-    void insertImpl(Queues<CompareAggressive> &aggressive_queues, Queues<ComparePassive> &passive_queues,
-                    Symbol symbol, Order &aggressive_order, bool is_buy);
+    /**
+     * Prefetches the order the command refers to or the best order it could trade with.
+     * Looks the order up, so its slot is expected to be prefetched already
+     */
+    void prefetchOrders(Command const &command) const;
+
+    /**
+     * Records time passed since the timer was started, does nothing if latency statistics aren't compiled in
+     */
+    void recordLatency(LatencyKind kind, LatencyTimer const &timer);
+
+    /**
+     * Matches the order and puts the rest of it to the book.
+     * Returns handle of the resting order or NULL_POOL_HANDLE if the order doesn't rest
+     */
+    template<Side side>
+    OrderHandle insertImpl(Book &book, SymbolId symbol, Order &aggressive_order);
+
+    /**
+     * Returns `true` if the order was changed in place and `false` if it was reinserted
+     */
+    template<Side side>
+    bool amendImpl(Book &book, OrderInfo info, Amend amend);
 
-    template<typename Compare>
-    void amendImpl(Queues<Compare> &queues, Symbol const &symbol, Amend amend, bool is_buy);
+    template<Side side>
+    Volume pullImpl(Book &book, OrderHandle handle);
+
+    /**
+     * Allocates the order and puts it to the book side
+     */
+    template<Side side>
+    OrderHandle rest(BookSide<side> &book_side, SymbolId symbol, Order const &order);
+
+    /**
+     * Reports the new volume of the level if there is a listener
+     */
+    void updateLevel(SymbolId symbol, Side side, Price price, Volume volume);
+
+    template<Side side>
+    void writeSide(BookSide<side> const &book_side, std::string &out) const;
+
+    template<Side side>
+    void restoreSide(ByteReader &reader, BookSide<side> &book_side, SymbolId symbol);
 };
 
+extern template class BasicCLOBEngine<price_ladder>;
+extern template class BasicCLOBEngine<price_tree>;
+extern template class BasicCLOBEngine<order_heap>;
+
+/**
+ * Engine with books kept in price ladders, the fastest storage on the bench flows
+ */
+typedef BasicCLOBEngine<price_ladder> CLOBEngine;
+
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * Hash map with integer keys stored in one flat array of slots.
+ * Collisions are resolved by linear probing with Robin Hood ordering, so every key is found within a short
+ * run of neighbouring slots. Erased keys are removed by shifting the following entries back instead of leaving
+ * tombstones, so lookups never slow down because of old deletions.
+ * Pointers to values are invalidated by insertions and erasures.
+ */
+template<typename Key, typename Value>
+class flat_hash_map {
+
+    static_assert(std::is_integral<Key>::value, "keys must be integers");
+
+public:
+
+    /**
+     * @param capacity - number of entries which can be inserted without rehashing
+     */
+    explicit flat_hash_map(size_t capacity = 16);
+
+    /**
+     * Returns the value by its key or `nullptr` if there is no such key
+     * O(1) expected time complexity
+     */
+    Value *find(Key key);
+
+    Value const *find(Key key) const;
+
+    /**
+     * Hints the processor to load the slot the key is hashed to, so a following lookup of the key
+     * doesn't wait for memory. Doesn't change anything
+     */
+    void prefetch(Key key) const;
+
+    /**
+     * Inserts the value if there is no such key yet.
+     * Returns the value stored by the key and `true` if the insertion took place
+     * O(1) amortized expected time complexity
+     */
+    std::pair<Value *, bool> insert(Key key, Value const &value);
+
+    /**
+     * Returns the value stored by the key, inserts default value if there is no such key
+     * O(1) amortized expected time complexity
+     */
+    Value &operator[](Key key);
+
+    /**
+     * Removes the key if it exists. Returns `true` if the key was removed
+     * O(1) expected time complexity
+     */
+    bool erase(Key key);
+
+    /**
+     * Number of stored entries
+     */
+    size_t size() const;
+
+    /**
+     * Makes room for `capacity` entries, so they can be inserted without rehashing
+     */
+    void reserve(size_t capacity);
+
+    /**
+     * Calls `f(key, value)` for every entry in unspecified order
+     * O(capacity) time complexity
+     */
+    template<typename F>
+    void forEach(F f) const;
+
+private:
+
+    struct Slot {
+        Key key;
+        Value value;
+        uint32_t distance; // 0 for empty slot, otherwise 1 + distance from the slot the key is hashed to
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t shift;
+    size_t entries;
+
+    size_t index(Key key) const;
+
+    size_t findIndex(Key key) const;
+
+    void rehash(size_t slots_count);
+
+    static bool overloaded(size_t entries_count, size_t slots_count);
+};
+
+template<typename Key, typename Value>
+flat_hash_map<Key, Value>::flat_hash_map(size_t capacity) : mask(0), shift(0), entries(0) {
+    size_t slots_count = 8;
+    while (overloaded(capacity, slots_count)) {
+        slots_count *= 2;
+    }
+    rehash(slots_count);
+}
+
+template<typename Key, typename Value>
+Value *flat_hash_map<Key, Value>::find(Key key) {
+    size_t i = findIndex(key);
+    return i == slots.size() ? nullptr : &slots[i].value;
+}
+
+template<typename Key, typename Value>
+Value const *flat_hash_map<Key, Value>::find(Key key) const {
+    size_t i = findIndex(key);
+    return i == slots.size() ? nullptr : &slots[i].value;
+}
+
+template<typename Key, typename Value>
+void flat_hash_map<Key, Value>::prefetch(Key key) const {
+    __builtin_prefetch(&slots[index(key)]);
+}
+
+template<typename Key, typename Value>
+std::pair<Value *, bool> flat_hash_map<Key, Value>::insert(Key key, Value const &value) {
+    Value *existing = find(key);
+    if (existing != nullptr) {
+        return {existing, false};
+    }
+    if (overloaded(entries + 1, slots.size())) {
+        rehash(slots.size() * 2);
+    }
+
+    // the new entry takes the slot of the first entry which is closer to its home, that entry moves further
+    Slot carried = Slot{key, value, 1};
+    Value *inserted = nullptr;
+    for (size_t i = index(key);; i = (i + 1) & mask, ++carried.distance) {
+        Slot &slot = slots[i];
+        if (slot.distance == 0) {
+            slot = std::move(carried);
+            ++entries;
+            return {inserted != nullptr ? inserted : &slot.value, true};
+        }
+        if (slot.distance < carried.distance) {
+            std::swap(slot, carried);
+            if (inserted == nullptr) {
+                inserted = &slot.value;
+            }
+        }
+    }
+}
+
+template<typename Key, typename Value>
+Value &flat_hash_map<Key, Value>::operator[](Key key) {
+    return *insert(key, Value()).first;
+}
+
+template<typename Key, typename Value>
+bool flat_hash_map<Key, Value>::erase(Key key) {
+    size_t i = findIndex(key);
+    if (i == slots.size()) {
+        return false;
+    }
+    // entries displaced from their homes move one slot back to fill the gap
+    for (size_t next = (i + 1) & mask; slots[next].distance > 1; i = next, next = (next + 1) & mask) {
+        slots[i] = std::move(slots[next]);
+        --slots[i].distance;
+    }
+    slots[i].distance = 0;
+    --entries;
+    return true;
+}
+
+template<typename Key, typename Value>
+size_t flat_hash_map<Key, Value>::size() const {
+    return entries;
+}
+
+template<typename Key, typename Value>
+void flat_hash_map<Key, Value>::reserve(size_t capacity) {
+    size_t slots_count = slots.size();
+    while (overloaded(capacity, slots_count)) {
+        slots_count *= 2;
+    }
+    if (slots_count != slots.size()) {
+        rehash(slots_count);
+    }
+}
+
+template<typename Key, typename Value>
+template<typename F>
+void flat_hash_map<Key, Value>::forEach(F f) const {
+    for (Slot const &slot : slots) {
+        if (slot.distance != 0) {
+            f(slot.key, slot.value);
+        }
+    }
+}
+
+/**
+ * Fibonacci hashing, it spreads sequential keys over the whole table
+ */
+template<typename Key, typename Value>
+size_t flat_hash_map<Key, Value>::index(Key key) const {
+    return static_cast<size_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> shift);
+}
+
+/**
+ * Returns index of the key's slot or number of slots if there is no such key
+ */
+template<typename Key, typename Value>
+size_t flat_hash_map<Key, Value>::findIndex(Key key) const {
+    uint32_t distance = 1;
+    for (size_t i = index(key);; i = (i + 1) & mask, ++distance) {
+        Slot const &slot = slots[i];
+        // Robin Hood ordering guarantees that the key would have taken this slot
+        if (slot.distance < distance) {
+            return slots.size();
+        }
+        if (slot.key == key) {
+            return i;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+void flat_hash_map<Key, Value>::rehash(size_t slots_count) {
+    std::vector<Slot> old_slots(slots_count);
+    std::swap(slots, old_slots);
+    mask = slots_count - 1;
+    shift = 64;
+    for (size_t count = slots_count; count > 1; count /= 2) {
+        --shift;
+    }
+    entries = 0;
+    for (Slot &slot : old_slots) {
+        if (slot.distance != 0) {
+            insert(slot.key, slot.value);
+        }
+    }
+}
+
+/**
+ * Load factor is kept below 0.8
+ */
+template<typename Key, typename Value>
+bool flat_hash_map<Key, Value>::overloaded(size_t entries_count, size_t slots_count) {
+    return entries_count * 5 > slots_count * 4;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "common.hpp"
+#include "level.hpp"
+#include "queue.hpp"
+#include "flat_hash_map.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/**
+ * One side of an order book kept as a binary heap of orders ordered by price and then by time.
+ * Only the best order is known without work, so levels are aggregated separately for level updates
+ * and the best level, and levels or orders are listed from a copy of them.
+ * Pulled orders are removed lazily {@see priority_queue}, most of them are never close to the top.
+ * Models the book side storage concept {@see BasicCLOBEngine}
+ */
+template<Side side>
+class order_heap {
+
+public:
+
+    order_heap();
+
+    /**
+     * Puts the order to the heap. Returns the new total volume of the order's level
+     * O(log(orders)) time complexity
+     */
+    Volume push(OrderPool &orders, OrderHandle handle);
+
+    /**
+     * Returns the oldest order with the best price
+     * O(1) time complexity
+     */
+    OrderHandle top() const;
+
+    /**
+     * Returns price and total volume of the best level
+     * O(1) expected time complexity
+     */
+    std::pair<Price, Volume> bestLevel() const;
+
+    /**
+     * Decreases the volume of the oldest order with the best price, the order is removed from the heap
+     * if nothing is left of it, the caller owns its slot then.
+     * Returns the new total volume of the level, 0 if the level is dropped
+     * O(log(orders)) time complexity
+     */
+    Volume fillTop(OrderPool &orders, Volume volume);
+
+    /**
+     * Changes the volume of the order in place, so it keeps its time priority.
+     * Returns the new total volume of the order's level
+     * O(1) expected time complexity
+     */
+    Volume setVolume(OrderPool &orders, OrderHandle handle, Volume volume);
+
+    /**
+     * Removes the order from the heap, the caller owns its slot then.
+     * Returns the new total volume of the order's level, 0 if the level is dropped
+     * O(1) amortized expected time complexity, O(log(orders)) for the top order
+     */
+    Volume remove(OrderPool &orders, OrderHandle handle);
+
+    /**
+     * `true` if there are no orders on this side, `false` otherwise
+     * O(1) time complexity
+     */
+    bool empty() const;
+
+    /**
+     * Calls `f(price, volume)` for levels from the best one while it returns `true`
+     * O(levels + visited levels * log(levels)) time complexity
+     */
+    template<typename F>
+    void forEachLevel(F f) const;
+
+    /**
+     * Calls `f(order)` for orders in their priority: levels from the best one, orders of a level in FIFO order
+     * O(orders * log(orders)) time complexity
+     */
+    template<typename F>
+    void forEachOrder(OrderPool const &orders, F f) const;
+
+private:
+
+    /**
+     * Ordering keys are copied to the heap, so sifting doesn't touch the orders
+     */
+    struct Entry {
+        Price price;
+        uint64_t time;
+        OrderHandle handle;
+    };
+
+    struct EntryComparator {
+        bool operator()(Entry const &lhs, Entry const &rhs) const {
+            return lhs.price != rhs.price ? isBetterPrice<side>(lhs.price, rhs.price) : lhs.time < rhs.time;
+        }
+    };
+
+    struct LevelTotals {
+        Volume volume;
+        uint32_t orders_cnt;
+    };
+
+    /**
+     * Share of pulled orders left in the heap which makes it rebuild without them
+     */
+    static constexpr double MAX_DEAD_SHARE = 0.75;
+
+    priority_queue<OrderHandle, Entry, EntryComparator, true> entries;
+
+    flat_hash_map<Price, LevelTotals> level_totals;
+
+    /**
+     * Accounts for the order leaving its level. Returns the new total volume of the level, 0 if it's dropped
+     */
+    Volume leaveLevel(Order const &order);
+};
+
+template<Side side>
+order_heap<side>::order_heap() : entries([](Entry const &entry) { return entry.handle; }, MAX_DEAD_SHARE) {}
+
+template<Side side>
+Volume order_heap<side>::push(OrderPool &orders, OrderHandle handle) {
+    Order const &order = orders[handle];
+    entries.push(Entry{order.price, order.time, handle});
+    LevelTotals &totals = level_totals[order.price];
+    totals.volume += order.volume;
+    ++totals.orders_cnt;
+    return totals.volume;
+}
+
+template<Side side>
+OrderHandle order_heap<side>::top() const {
+    return entries.top().handle;
+}
+
+template<Side side>
+std::pair<Price, Volume> order_heap<side>::bestLevel() const {
+    Price price = entries.top().price;
+    return {price, level_totals.find(price)->volume};
+}
+
+template<Side side>
+Volume order_heap<side>::fillTop(OrderPool &orders, Volume volume) {
+    Order &order = orders[entries.top().handle];
+    order.volume -= volume;
+    LevelTotals &totals = *level_totals.find(order.price);
+    totals.volume -= volume;
+    if (order.volume != 0) {
+        return totals.volume;
+    }
+    entries.pop();
+    return leaveLevel(order);
+}
+
+template<Side side>
+Volume order_heap<side>::setVolume(OrderPool &orders, OrderHandle handle, Volume volume) {
+    Order &order = orders[handle];
+    LevelTotals &totals = *level_totals.find(order.price);
+    totals.volume += volume - order.volume;
+    order.volume = volume;
+    return totals.volume;
+}
+
+template<Side side>
+Volume order_heap<side>::remove(OrderPool &orders, OrderHandle handle) {
+    entries.remove(entries.find(handle));
+    return leaveLevel(orders[handle]);
+}
+
+template<Side side>
+bool order_heap<side>::empty() const {
+    return entries.empty();
+}
+
+template<Side side>
+template<typename F>
+void order_heap<side>::forEachLevel(F f) const {
+    std::vector<std::pair<Price, Volume>> levels;
+    levels.reserve(level_totals.size());
+    level_totals.forEach([&levels](Price price, LevelTotals const &totals) {
+        levels.emplace_back(price, totals.volume);
+    });
+    // levels are ordered lazily, so visiting a few best levels doesn't sort all of them
+    auto is_worse = [](std::pair<Price, Volume> const &lhs, std::pair<Price, Volume> const &rhs) {
+        return isBetterPrice<side>(rhs.first, lhs.first);
+    };
+    std::make_heap(levels.begin(), levels.end(), is_worse);
+    for (auto it_end = levels.end(); it_end != levels.begin(); --it_end) {
+        std::pop_heap(levels.begin(), it_end, is_worse);
+        if (!f(std::prev(it_end)->first, std::prev(it_end)->second)) {
+            return;
+        }
+    }
+}
+
+template<Side side>
+template<typename F>
+void order_heap<side>::forEachOrder(OrderPool const &orders, F f) const {
+    std::vector<Entry> sorted_entries;
+    entries.forEach([&sorted_entries](Entry const &entry) {
+        sorted_entries.push_back(entry);
+    });
+    std::sort(sorted_entries.begin(), sorted_entries.end(), EntryComparator());
+    for (Entry const &entry : sorted_entries) {
+        f(orders[entry.handle]);
+    }
+}
+
+template<Side side>
+Volume order_heap<side>::leaveLevel(Order const &order) {
+    LevelTotals &totals = *level_totals.find(order.price);
+    totals.volume -= order.volume;
+    if (--totals.orders_cnt == 0) {
+        level_totals.erase(order.price);
+        return 0;
+    }
+    return totals.volume;
+}
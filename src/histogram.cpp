@@ -0,0 +1,66 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+
+/* LatencyHistogram definition */
+
+void LatencyHistogram::merge(LatencyHistogram const &other) {
+    for (size_t i = 0; i < BUCKETS_CNT; ++i) {
+        counts[i] += other.counts[i];
+    }
+    values_cnt += other.values_cnt;
+    min_value = std::min(min_value, other.min_value);
+    max_value = std::max(max_value, other.max_value);
+    sum += other.sum;
+}
+
+void LatencyHistogram::reset() {
+    *this = LatencyHistogram();
+}
+
+uint64_t LatencyHistogram::count() const {
+    return values_cnt;
+}
+
+uint64_t LatencyHistogram::min() const {
+    return values_cnt == 0 ? 0 : min_value;
+}
+
+uint64_t LatencyHistogram::max() const {
+    return max_value;
+}
+
+double LatencyHistogram::mean() const {
+    return values_cnt == 0 ? 0 : double(sum) / values_cnt;
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+    if (values_cnt == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(percent / 100 * values_cnt + 0.5));
+    uint64_t seen_cnt = 0;
+    for (size_t i = 0; i < BUCKETS_CNT; ++i) {
+        seen_cnt += counts[i];
+        if (seen_cnt >= rank) {
+            return std::min(highestValue(i), max_value);
+        }
+    }
+    return max_value;
+}
+
+uint64_t LatencyHistogram::highestValue(size_t bucket) {
+    if (bucket < 2 * SUB_BUCKETS_CNT) {
+        return bucket;
+    }
+    unsigned shift = bucket / SUB_BUCKETS_CNT - 1;
+    uint64_t mantissa = bucket - shift * SUB_BUCKETS_CNT;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void printLatencies(std::ostream &out, char const *name, LatencyHistogram const &histogram) {
+    out << name << ": count " << histogram.count() << ", mean " << uint64_t(histogram.mean())
+        << " ns, p50 " << histogram.percentile(50) << " ns, p99 " << histogram.percentile(99)
+        << " ns, p99.9 " << histogram.percentile(99.9) << " ns, p99.99 " << histogram.percentile(99.99)
+        << " ns, max " << histogram.max() << " ns\n";
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Histogram of latencies in nanoseconds with log-linear buckets, like HDR histograms:
+ * every power of two range is split into SUB_BUCKETS_CNT equal buckets, so any recorded value is known
+ * within ~3% and recording is a few arithmetic operations and one increment, without allocations
+ */
+class LatencyHistogram {
+public:
+
+    static constexpr unsigned SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS_CNT = uint64_t(1) << SUB_BUCKET_BITS;
+
+    /**
+     * O(1) time complexity
+     */
+    void record(uint64_t value);
+
+    /**
+     * Adds values recorded by the other histogram
+     */
+    void merge(LatencyHistogram const &other);
+
+    void reset();
+
+    uint64_t count() const;
+
+    uint64_t min() const;
+
+    uint64_t max() const;
+
+    double mean() const;
+
+    /**
+     * Returns the highest value equivalent to the value at the percentile (0..100), 0 if nothing is recorded
+     * O(buckets) time complexity
+     */
+    uint64_t percentile(double percent) const;
+
+private:
+
+    /**
+     * Values below 2 * SUB_BUCKETS_CNT have their own buckets, then there are SUB_BUCKETS_CNT buckets
+     * for every further power of two
+     */
+    static constexpr size_t BUCKETS_CNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS_CNT;
+
+    std::array<uint64_t, BUCKETS_CNT> counts{};
+    uint64_t values_cnt = 0;
+    uint64_t min_value = UINT64_MAX;
+    uint64_t max_value = 0;
+    uint64_t sum = 0;
+
+    static size_t bucket(uint64_t value);
+
+    /**
+     * The highest value which falls to the bucket
+     */
+    static uint64_t highestValue(size_t bucket);
+};
+
+/**
+ * Prints count, mean, percentiles and maximum of the histogram on one line, prefixed by `name`
+ */
+void printLatencies(std::ostream &out, char const *name, LatencyHistogram const &histogram);
+
+/**
+ * Measures time since construction if latency statistics are compiled in (WEBBTRADERS_LATENCY_STATS),
+ * and is empty otherwise, so disabled instrumentation costs nothing
+ */
+class LatencyTimer {
+public:
+
+#ifdef WEBBTRADERS_LATENCY_STATS
+    static constexpr bool ENABLED = true;
+
+    uint64_t elapsed() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point start = Clock::now();
+#else
+    static constexpr bool ENABLED = false;
+
+    uint64_t elapsed() const {
+        return 0;
+    }
+#endif
+};
+
+inline void LatencyHistogram::record(uint64_t value) {
+    ++counts[bucket(value)];
+    ++values_cnt;
+    min_value = value < min_value ? value : min_value;
+    max_value = value > max_value ? value : max_value;
+    sum += value;
+}
+
+inline size_t LatencyHistogram::bucket(uint64_t value) {
+    if (value < 2 * SUB_BUCKETS_CNT) {
+        return value;
+    }
+    unsigned shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+    return shift * SUB_BUCKETS_CNT + (value >> shift);
+}
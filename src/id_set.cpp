@@ -0,0 +1,120 @@
+#include "id_set.hpp"
+#include "binary.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+/* OrderIdSet definition */
+
+bool OrderIdSet::insert(OrderId order_id) {
+    Page &page = pages[order_id >> PAGE_BITS];
+    auto offset = static_cast<uint16_t>(order_id & (PAGE_SIZE - 1));
+    if (page.bitmap_index == NO_BITMAP) {
+        auto it_offset = std::find(page.offsets.begin(), page.offsets.end(), offset);
+        if (it_offset != page.offsets.end()) {
+            return false;
+        }
+        it_offset = std::find(page.offsets.begin(), page.offsets.end(), NO_OFFSET);
+        if (it_offset != page.offsets.end()) {
+            *it_offset = offset;
+            return true;
+        }
+        allocateBitmap(page);
+    }
+    uint64_t &word = bitmaps[page.bitmap_index][offset / 64];
+    uint64_t bit = uint64_t(1) << (offset & 63);
+    if ((word & bit) != 0) {
+        return false;
+    }
+    word |= bit;
+    return true;
+}
+
+bool OrderIdSet::contains(OrderId order_id) const {
+    Page const *page = pages.find(order_id >> PAGE_BITS);
+    if (page == nullptr) {
+        return false;
+    }
+    auto offset = static_cast<uint16_t>(order_id & (PAGE_SIZE - 1));
+    if (page->bitmap_index == NO_BITMAP) {
+        return std::find(page->offsets.begin(), page->offsets.end(), offset) != page->offsets.end();
+    }
+    return (bitmaps[page->bitmap_index][offset / 64] >> (offset & 63) & 1) != 0;
+}
+
+size_t OrderIdSet::pagesCount() const {
+    return pages.size();
+}
+
+size_t OrderIdSet::bitmapsCount() const {
+    return bitmaps.size();
+}
+
+void OrderIdSet::writeSnapshot(std::string &out) const {
+    appendLittleEndian<uint64_t>(out, pages.size());
+    pages.forEach([this, &out](int64_t page_number, Page const &page) {
+        appendLittleEndian<int64_t>(out, page_number);
+        if (page.bitmap_index == NO_BITMAP) {
+            auto offsets_cnt = std::count_if(page.offsets.begin(), page.offsets.end(), [](uint16_t offset) {
+                return offset != NO_OFFSET;
+            });
+            appendLittleEndian<uint16_t>(out, static_cast<uint16_t>(offsets_cnt));
+            for (uint16_t offset : page.offsets) {
+                if (offset != NO_OFFSET) {
+                    appendLittleEndian<uint16_t>(out, offset);
+                }
+            }
+            return;
+        }
+        appendLittleEndian<uint16_t>(out, 0);
+        for (uint64_t word : bitmaps[page.bitmap_index]) {
+            appendLittleEndian<uint64_t>(out, word);
+        }
+    });
+}
+
+void OrderIdSet::restoreSnapshot(ByteReader &reader) {
+    if (pages.size() != 0) {
+        throw std::runtime_error("order identifiers can only be restored to an empty set");
+    }
+    // every page takes at least its number, the number of offsets and one offset
+    auto pages_cnt = reader.read<uint64_t>();
+    if (pages_cnt > reader.rest().size() / (sizeof(int64_t) + 2 * sizeof(uint16_t))) {
+        throw std::runtime_error("invalid number of pages of order identifiers");
+    }
+    pages.reserve(pages_cnt);
+    for (uint64_t i = 0; i < pages_cnt; ++i) {
+        auto page_number = reader.read<int64_t>();
+        auto [page, is_new_page] = pages.insert(page_number, Page());
+        if (!is_new_page) {
+            throw std::runtime_error("duplicate page of order identifiers");
+        }
+        auto offsets_cnt = reader.read<uint16_t>();
+        if (offsets_cnt > INLINE_OFFSETS_CNT) {
+            throw std::runtime_error("invalid page of order identifiers");
+        }
+        for (uint16_t j = 0; j < offsets_cnt; ++j) {
+            auto offset = reader.read<uint16_t>();
+            bool is_duplicate = std::find(page->offsets.begin(), page->offsets.end(), offset) != page->offsets.end();
+            if (offset >= PAGE_SIZE || is_duplicate) {
+                throw std::runtime_error("invalid page of order identifiers");
+            }
+            page->offsets[j] = offset;
+        }
+        if (offsets_cnt == 0) {
+            page->bitmap_index = static_cast<uint32_t>(bitmaps.size());
+            for (uint64_t &word : bitmaps.emplace_back()) {
+                word = reader.read<uint64_t>();
+            }
+        }
+    }
+}
+
+void OrderIdSet::allocateBitmap(Page &page) {
+    page.bitmap_index = static_cast<uint32_t>(bitmaps.size());
+    Bitmap &bitmap = bitmaps.emplace_back();
+    bitmap.fill(0);
+    for (uint16_t offset : page.offsets) {
+        bitmap[offset / 64] |= uint64_t(1) << (offset & 63);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "common.hpp"
+#include "flat_hash_map.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class ByteReader;
+
+/**
+ * Set of order identifiers split into pages of `PAGE_SIZE` consecutive identifiers.
+ * Identifiers are usually assigned sequentially, so a page holds hundreds of them in a 128 bytes bitmap
+ * and memory grows by a bit per order instead of a hash table entry per order.
+ * A page with a few identifiers keeps their offsets inline in its hash table entry instead,
+ * so sparse identifiers cost about as much as in a plain hash set, the bitmap is allocated once the page fills up.
+ * Identifiers are never removed
+ */
+class OrderIdSet {
+public:
+
+    static constexpr size_t PAGE_BITS = 10;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+    /**
+     * Adds the identifier. Returns `true` if it wasn't in the set yet
+     * O(1) amortized expected time complexity
+     */
+    bool insert(OrderId order_id);
+
+    /**
+     * `true` if the identifier is in the set
+     * O(1) expected time complexity
+     */
+    bool contains(OrderId order_id) const;
+
+    /**
+     * Number of pages with identifiers
+     */
+    size_t pagesCount() const;
+
+    /**
+     * Number of pages which allocated a bitmap
+     */
+    size_t bitmapsCount() const;
+
+    /**
+     * Appends the set to `out`: u64 number of pages, then for every page i64 page number, u16 number of inline
+     * offsets and the u16 offsets, or 0 and `PAGE_SIZE / 64` u64 words of bits for a page with a bitmap, little-endian
+     */
+    void writeSnapshot(std::string &out) const;
+
+    /**
+     * Reads the set written by {@see writeSnapshot}, the set must be empty.
+     * Throws std::runtime_error if the data is invalid
+     */
+    void restoreSnapshot(ByteReader &reader);
+
+private:
+
+    static constexpr size_t PAGE_WORDS = PAGE_SIZE / 64;
+
+    /**
+     * Identifiers a page keeps inline before it allocates a bitmap, the entry stays as small as its key
+     */
+    static constexpr size_t INLINE_OFFSETS_CNT = 4;
+
+    static constexpr uint32_t NO_BITMAP = UINT32_MAX;
+    static constexpr uint16_t NO_OFFSET = UINT16_MAX;
+
+    typedef std::array<uint64_t, PAGE_WORDS> Bitmap;
+
+    struct Page {
+        uint32_t bitmap_index = NO_BITMAP; // index in `bitmaps`
+        std::array<uint16_t, INLINE_OFFSETS_CNT> offsets = {NO_OFFSET, NO_OFFSET, NO_OFFSET, NO_OFFSET};
+    };
+
+    /**
+     * Pages by page number, i.e. identifier divided by `PAGE_SIZE`
+     */
+    flat_hash_map<int64_t, Page> pages;
+
+    std::vector<Bitmap> bitmaps;
+
+    /**
+     * Moves inline offsets of the page to a new bitmap
+     */
+    void allocateBitmap(Page &page);
+};
@@ -0,0 +1,332 @@
+#include "journal.hpp"
+#include "binary.hpp"
+#include "writer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* journal helpers */
+
+static size_t const JOURNAL_HEADER_SIZE = 8;
+static size_t const GROUP_HEADER_SIZE = 20;
+static size_t const SYMBOL_RECORD_HEADER_SIZE = 12;
+
+/**
+ * Type of symbol definition records, the following types of command records
+ */
+static uint8_t const SYMBOL_RECORD = 3;
+
+/**
+ * Journal symbols which aren't defined yet
+ */
+static SymbolId const UNKNOWN_SYMBOL = std::numeric_limits<SymbolId>::max();
+
+/**
+ * Groups are never larger, so a corrupted size isn't taken for a huge allocation
+ */
+static uint32_t const MAX_GROUP_SIZE = 1u << 30;
+
+/**
+ * FNV-1a hash, cheap enough to cover every group and enough to detect a torn write
+ */
+static uint32_t checksum(std::string_view header, std::string_view payload) {
+    uint32_t hash = 2166136261u;
+    for (std::string_view data : {header, payload}) {
+        for (char byte : data) {
+            hash = (hash ^ static_cast<unsigned char>(byte)) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static void writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("can't write journal");
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+}
+
+static void sync(int fd) {
+    if (fdatasync(fd) < 0) {
+        throw std::runtime_error("can't sync journal");
+    }
+}
+
+/* JournalWriter definition */
+
+JournalWriter::JournalWriter(std::string const &path, SymbolTable const &symbols, JournalPosition start,
+                             JournalPolicy policy) : symbols(symbols), policy(policy),
+                                                     group(GROUP_HEADER_SIZE, '\0'), group_commands_cnt(0),
+                                                     next_sequence(start.sequence), last_commit(Clock::now()),
+                                                     defined_symbols_cnt(0) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("can't open " + path);
+    }
+    try {
+        // whatever follows the valid part is a torn group of a crashed writer
+        if (ftruncate(fd, static_cast<off_t>(start.size)) < 0 ||
+            lseek(fd, static_cast<off_t>(start.size), SEEK_SET) < 0) {
+            throw std::runtime_error("can't truncate " + path);
+        }
+        if (start.size == 0) {
+            std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+            appendLittleEndian<uint32_t>(header, JOURNAL_VERSION);
+            writeAll(fd, header);
+            sync(fd);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+}
+
+JournalWriter::~JournalWriter() {
+    try {
+        commit();
+    } catch (std::runtime_error const &) {
+        // destructor can't report the failure, callers which care commit explicitly
+    }
+    close(fd);
+}
+
+void JournalWriter::append(Commands const &commands) {
+    for (Command const &command : commands) {
+        if (auto insert = std::get_if<Insert>(&command)) {
+            if (insert->symbol >= defined_symbols_cnt) {
+                defineSymbols(insert->symbol);
+            }
+        }
+        size_t offset = group.size();
+        group.resize(offset + COMMAND_RECORD_SIZE);
+        encodeCommand(command, &group[offset]);
+    }
+    group_commands_cnt += static_cast<uint32_t>(commands.size());
+    next_sequence += commands.size();
+
+    if (group.size() - GROUP_HEADER_SIZE >= policy.sync_size) {
+        commit();
+    } else {
+        commitIfDue();
+    }
+}
+
+void JournalWriter::commit() {
+    last_commit = Clock::now();
+    if (group_commands_cnt == 0) {
+        return;
+    }
+    storeLittleEndian<uint32_t>(&group[0], static_cast<uint32_t>(group.size() - GROUP_HEADER_SIZE));
+    storeLittleEndian<uint32_t>(&group[4], group_commands_cnt);
+    storeLittleEndian<uint64_t>(&group[8], next_sequence - group_commands_cnt);
+    std::string_view group_view = group;
+    storeLittleEndian<uint32_t>(&group[16], checksum(group_view.substr(0, 16),
+                                                     group_view.substr(GROUP_HEADER_SIZE)));
+    group_commands_cnt = 0;
+    std::string written;
+    std::swap(written, group);
+    group.assign(GROUP_HEADER_SIZE, '\0');
+    group.reserve(written.capacity());
+    writeAll(fd, written);
+    sync(fd);
+}
+
+void JournalWriter::commitIfDue() {
+    if (Clock::now() - last_commit >= policy.sync_interval) {
+        commit();
+    }
+}
+
+uint64_t JournalWriter::sequence() const {
+    return next_sequence;
+}
+
+uint64_t JournalWriter::syncedSequence() const {
+    return next_sequence - group_commands_cnt;
+}
+
+/**
+ * Symbols are defined in order of their identifiers, so the writer only remembers how many are defined
+ */
+void JournalWriter::defineSymbols(SymbolId symbol) {
+    for (; defined_symbols_cnt <= symbol; ++defined_symbols_cnt) {
+        Symbol const &name = symbols.name(static_cast<SymbolId>(defined_symbols_cnt));
+        size_t offset = group.size();
+        group.resize(offset + SYMBOL_RECORD_HEADER_SIZE);
+        group[offset] = static_cast<char>(SYMBOL_RECORD);
+        storeLittleEndian<uint32_t>(&group[offset + 4], static_cast<uint32_t>(defined_symbols_cnt));
+        storeLittleEndian<uint32_t>(&group[offset + 8], static_cast<uint32_t>(name.size()));
+        group.append(name);
+    }
+}
+
+/* JournaledOutput definition */
+
+JournaledOutput::JournaledOutput(JournalWriter &journal, BufferedWriter &writer) : journal(journal), writer(writer) {}
+
+void JournaledOutput::write(std::string_view text) {
+    journal.commitIfDue();
+    if (journal.syncedSequence() != journal.sequence()) {
+        pending.append(text);
+        return;
+    }
+    writer.write(pending);
+    writer.write(text);
+    pending.clear();
+}
+
+void JournaledOutput::flush() {
+    journal.commit();
+    writer.write(pending);
+    pending.clear();
+}
+
+size_t JournaledOutput::held() const {
+    return pending.size();
+}
+
+/* JournalReader definition */
+
+JournalReader::JournalReader(std::string const &path, SymbolTable &symbols, uint64_t first_sequence,
+                             size_t read_size) : symbols(symbols), first_sequence(first_sequence),
+                                                 read_size(read_size), is_eof(false), buffer_offset(0),
+                                                 has_groups(false) {
+    end.sequence = first_sequence;
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            throw std::runtime_error("can't open " + path);
+        }
+        is_eof = true;
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    try {
+        // a header which isn't written completely is left by a writer which crashed before any command
+        if (!fill(JOURNAL_HEADER_SIZE)) {
+            return;
+        }
+        std::string_view header(buffer.data(), JOURNAL_HEADER_SIZE);
+        if (header.substr(0, sizeof(JOURNAL_MAGIC)) != std::string_view(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) ||
+            loadLittleEndian<uint32_t>(header.data() + 4) != JOURNAL_VERSION) {
+            throw std::runtime_error("invalid journal header");
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    buffer_offset = JOURNAL_HEADER_SIZE;
+    end.size = JOURNAL_HEADER_SIZE;
+}
+
+JournalReader::~JournalReader() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool JournalReader::read(Commands &commands) {
+    if (end.size != 0 && fill(GROUP_HEADER_SIZE)) {
+        std::string_view header(buffer.data() + buffer_offset, GROUP_HEADER_SIZE);
+        auto payload_size = loadLittleEndian<uint32_t>(header.data());
+        auto commands_cnt = loadLittleEndian<uint32_t>(header.data() + 4);
+        auto sequence = loadLittleEndian<uint64_t>(header.data() + 8);
+        if (payload_size <= MAX_GROUP_SIZE && fill(GROUP_HEADER_SIZE + payload_size)) {
+            header = std::string_view(buffer.data() + buffer_offset, GROUP_HEADER_SIZE);
+            std::string_view payload(buffer.data() + buffer_offset + GROUP_HEADER_SIZE, payload_size);
+            if (loadLittleEndian<uint32_t>(header.data() + 16) == checksum(header.substr(0, 16), payload)) {
+                if (has_groups ? sequence != end.sequence : sequence > first_sequence) {
+                    throw std::runtime_error("journal misses commands before sequence " + std::to_string(sequence));
+                }
+                decodeGroup(payload, commands_cnt, sequence, commands);
+                has_groups = true;
+                buffer_offset += GROUP_HEADER_SIZE + payload_size;
+                end.size += GROUP_HEADER_SIZE + payload_size;
+                end.sequence = sequence + commands_cnt;
+                return true;
+            }
+        }
+    }
+    // the rest is either empty or a torn group
+    if (has_groups && end.sequence < first_sequence) {
+        throw std::runtime_error("journal ends before sequence " + std::to_string(first_sequence));
+    }
+    end.sequence = std::max(end.sequence, first_sequence);
+    return false;
+}
+
+JournalPosition JournalReader::position() const {
+    return end;
+}
+
+bool JournalReader::fill(size_t size) {
+    while (buffer.size() - buffer_offset < size && !is_eof) {
+        buffer.erase(0, buffer_offset);
+        buffer_offset = 0;
+        size_t old_size = buffer.size();
+        buffer.resize(old_size + std::max(read_size, size - old_size));
+        ssize_t read_cnt = ::read(fd, &buffer[old_size], buffer.size() - old_size);
+        if (read_cnt < 0) {
+            buffer.resize(old_size);
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("can't read journal");
+        }
+        buffer.resize(old_size + static_cast<size_t>(read_cnt));
+        is_eof = read_cnt == 0;
+    }
+    return buffer.size() - buffer_offset >= size;
+}
+
+void JournalReader::decodeGroup(std::string_view payload, uint32_t commands_cnt, uint64_t sequence,
+                                Commands &commands) {
+    uint32_t decoded_cnt = 0;
+    while (!payload.empty()) {
+        if (static_cast<uint8_t>(payload[0]) == SYMBOL_RECORD) {
+            if (payload.size() < SYMBOL_RECORD_HEADER_SIZE) {
+                throw std::runtime_error("invalid journal symbol record");
+            }
+            auto symbol = loadLittleEndian<uint32_t>(payload.data() + 4);
+            auto name_size = loadLittleEndian<uint32_t>(payload.data() + 8);
+            if (payload.size() - SYMBOL_RECORD_HEADER_SIZE < name_size) {
+                throw std::runtime_error("invalid journal symbol record");
+            }
+            if (symbol >= symbol_ids.size()) {
+                symbol_ids.resize(symbol + 1, UNKNOWN_SYMBOL);
+            }
+            symbol_ids[symbol] = symbols.intern(payload.substr(SYMBOL_RECORD_HEADER_SIZE, name_size));
+            payload.remove_prefix(SYMBOL_RECORD_HEADER_SIZE + name_size);
+            continue;
+        }
+
+        if (payload.size() < COMMAND_RECORD_SIZE) {
+            throw std::runtime_error("invalid journal command record");
+        }
+        Command command = decodeCommand(payload.data());
+        payload.remove_prefix(COMMAND_RECORD_SIZE);
+        if (auto insert = std::get_if<Insert>(&command)) {
+            if (insert->symbol >= symbol_ids.size() || symbol_ids[insert->symbol] == UNKNOWN_SYMBOL) {
+                throw std::runtime_error("unknown symbol in journal insert record");
+            }
+            insert->symbol = symbol_ids[insert->symbol];
+        }
+        if (sequence + decoded_cnt >= first_sequence) {
+            commands.push_back(command);
+        }
+        ++decoded_cnt;
+    }
+    if (decoded_cnt != commands_cnt) {
+        throw std::runtime_error("invalid journal group");
+    }
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "common.hpp"
+#include "symbols.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class BufferedWriter;
+
+/**
+ * Journal format, all integers are little-endian:
+ * - header: magic "WBTJ", u32 format version
+ * - groups of records, each written and synced at once:
+ *   u32 payload size, u32 number of commands, u64 sequence number of the first command,
+ *   u32 FNV-1a checksum of the previous fields and the payload, then the payload
+ * - payload is a sequence of records: commands in the binary commands format {@see COMMAND_RECORD_SIZE},
+ *   and symbol definitions, which precede the first command of the writer referring to the symbol:
+ *   u8 type 3, 3 zero bytes, u32 symbol identifier, u32 name length, name bytes
+ * A crash can leave a partially written group at the end, such group fails the checksum or the size check,
+ * so reading stops before it and a writer cuts it off
+ */
+
+static char const JOURNAL_MAGIC[4] = {'W', 'B', 'T', 'J'};
+static uint32_t const JOURNAL_VERSION = 1;
+
+/**
+ * End of the valid part of a journal
+ */
+struct JournalPosition {
+    uint64_t size = 0; // bytes
+    uint64_t sequence = 0; // sequence number of the next command
+};
+
+/**
+ * When appended commands are synced to the disk
+ */
+struct JournalPolicy {
+    std::chrono::microseconds sync_interval = std::chrono::milliseconds(10);
+    size_t sync_size = 1 << 20; // bytes of pending records
+};
+
+/**
+ * Appends commands to a journal before they are applied.
+ * Commands are collected into a group, which is written and synced with one write and one fdatasync
+ * once it's older than the sync interval or larger than the sync size, so durability costs one sync per group
+ * instead of one per command. The age is checked when commands are appended and by {@see commitIfDue},
+ * which callers waiting between appends call periodically, {@see commit} syncs right away
+ */
+class JournalWriter {
+public:
+
+    /**
+     * Opens or creates the journal and cuts it to `start`, the end of its valid part {@see JournalReader::position}.
+     * Names of symbols are taken from `symbols`, which must outlive the writer.
+     * Throws std::runtime_error if the journal can't be opened
+     */
+    JournalWriter(std::string const &path, SymbolTable const &symbols, JournalPosition start,
+                  JournalPolicy policy = JournalPolicy());
+
+    JournalWriter(JournalWriter const &) = delete;
+
+    JournalWriter &operator=(JournalWriter const &) = delete;
+
+    /**
+     * Commits pending commands and closes the journal
+     */
+    ~JournalWriter();
+
+    /**
+     * Adds the commands to the pending group, commits the group if the policy says so
+     */
+    void append(Commands const &commands);
+
+    /**
+     * Writes and syncs pending commands. Throws std::runtime_error on failure
+     */
+    void commit();
+
+    /**
+     * Commits pending commands if the group is older than the sync interval
+     */
+    void commitIfDue();
+
+    /**
+     * Sequence number of the next appended command
+     */
+    uint64_t sequence() const;
+
+    /**
+     * Sequence number of the first command which isn't synced yet
+     */
+    uint64_t syncedSequence() const;
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    int fd;
+    SymbolTable const &symbols;
+    JournalPolicy policy;
+
+    /**
+     * Pending group, starting with space for its header
+     */
+    std::string group;
+    uint32_t group_commands_cnt;
+    uint64_t next_sequence;
+    Clock::time_point last_commit;
+
+    /**
+     * Symbols with lower identifiers are defined in the journal by this writer
+     */
+    size_t defined_symbols_cnt;
+
+    void defineSymbols(SymbolId symbol);
+};
+
+/**
+ * Output of journaled commands, e.g. their trades, which is held back until the commands are synced,
+ * so nothing is published that a crash could take back
+ */
+class JournaledOutput {
+public:
+
+    /**
+     * Both the journal and the writer must outlive the output
+     */
+    JournaledOutput(JournalWriter &journal, BufferedWriter &writer);
+
+    /**
+     * Adds output of all the commands appended to the journal so far.
+     * Held output is passed to the writer once the journal syncs its commands, a due group is committed first
+     */
+    void write(std::string_view text);
+
+    /**
+     * Commits the journal and passes all held output to the writer
+     */
+    void flush();
+
+    /**
+     * Bytes of output held back
+     */
+    size_t held() const;
+
+private:
+
+    JournalWriter &journal;
+    BufferedWriter &writer;
+    std::string pending;
+};
+
+/**
+ * Reads commands from a journal with large sequential reads, without parsing text
+ */
+class JournalReader {
+public:
+
+    static size_t const DEFAULT_READ_SIZE = 1 << 20;
+
+    /**
+     * Opens the journal, a missing file is read as an empty journal.
+     * Symbols of the journal are interned into `symbols`. Commands with sequence numbers below `first_sequence`
+     * are skipped, e.g. ones which are already applied to a restored snapshot.
+     * Throws std::runtime_error if the journal can't be read or its header is invalid
+     */
+    JournalReader(std::string const &path, SymbolTable &symbols, uint64_t first_sequence = 0,
+                  size_t read_size = DEFAULT_READ_SIZE);
+
+    JournalReader(JournalReader const &) = delete;
+
+    JournalReader &operator=(JournalReader const &) = delete;
+
+    ~JournalReader();
+
+    /**
+     * Appends commands of the next group to `commands`. Returns `false` at the end of the valid part.
+     * Throws std::runtime_error if the journal doesn't contain the commands since `first_sequence`
+     */
+    bool read(Commands &commands);
+
+    /**
+     * End of the groups read so far, the next writer continues from here
+     */
+    JournalPosition position() const;
+
+private:
+
+    int fd;
+    SymbolTable &symbols;
+    uint64_t first_sequence;
+    size_t read_size;
+    bool is_eof;
+
+    /**
+     * Data read from the file and not consumed yet
+     */
+    std::string buffer;
+    size_t buffer_offset;
+
+    JournalPosition end;
+    bool has_groups;
+
+    /**
+     * Identifiers in `symbols` of the journal's symbol identifiers
+     */
+    std::vector<SymbolId> symbol_ids;
+
+    /**
+     * Reads until at least `size` bytes are buffered or the file ends, returns `true` if they are buffered
+     */
+    bool fill(size_t size);
+
+    void decodeGroup(std::string_view payload, uint32_t commands_cnt, uint64_t sequence, Commands &commands);
+};
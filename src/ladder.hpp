@@ -0,0 +1,216 @@
+#pragma once
+
+#include "common.hpp"
+#include "level.hpp"
+
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/**
+ * One side of an order book organized as price levels.
+ * Every level keeps its orders in FIFO, so orders with the same price are served in arrival order.
+ * Levels are kept sorted from the worst price to the best one, so the best level is always at the back
+ * and there are usually only a few levels to shift when a new price appears near the top of the book.
+ * Orders themselves are stored in {@see OrderPool} shared by all ladders and linked into their levels' FIFOs,
+ * so they never move while they rest.
+ * Models the book side storage concept {@see BasicCLOBEngine}
+ */
+template<Side side>
+class price_ladder {
+
+public:
+
+    struct Level : public PriceLevel {
+        Price price;
+
+        explicit Level(Price price) : price(price) {}
+    };
+
+    /**
+     * `true` if `lhs` price is more attractive than `rhs` for this side
+     */
+    static bool better(Price lhs, Price rhs);
+
+    /**
+     * Appends the order to the end of its price level, creating the level if needed.
+     * Returns the new total volume of the level
+     * O(log(levels)) time complexity, plus shifting of better levels when a new level is created
+     */
+    Volume push(OrderPool &orders, OrderHandle handle);
+
+    /**
+     * Returns the oldest order on the best level
+     * O(1) time complexity
+     */
+    OrderHandle top() const;
+
+    /**
+     * Returns price and total volume of the best level
+     * O(1) time complexity
+     */
+    std::pair<Price, Volume> bestLevel() const;
+
+    /**
+     * Decreases the volume of the oldest order on the best level, the order is unlinked from the ladder
+     * if nothing is left of it, the caller owns its slot then.
+     * Returns the new total volume of the level, 0 if the level is dropped
+     * O(1) time complexity
+     */
+    Volume fillTop(OrderPool &orders, Volume volume);
+
+    /**
+     * Changes the volume of the order in place, so it keeps its time priority.
+     * Returns the new total volume of the order's level
+     * O(log(levels)) time complexity
+     */
+    Volume setVolume(OrderPool &orders, OrderHandle handle, Volume volume);
+
+    /**
+     * Unlinks the order from the ladder, the caller owns its slot then.
+     * Returns the new total volume of the order's level, 0 if the level is dropped
+     * O(log(levels)) time complexity
+     */
+    Volume remove(OrderPool &orders, OrderHandle handle);
+
+    /**
+     * `true` if there are no orders on this side, `false` otherwise
+     * O(1) time complexity
+     */
+    bool empty() const;
+
+    /**
+     * Calls `f(price, volume)` for levels from the best one while it returns `true`
+     * O(visited levels) time complexity
+     */
+    template<typename F>
+    void forEachLevel(F f) const;
+
+    /**
+     * Calls `f(order)` for orders in their priority: levels from the best one, orders of a level in FIFO order
+     * O(orders) time complexity
+     */
+    template<typename F>
+    void forEachOrder(OrderPool const &orders, F f) const;
+
+    /**
+     * Price levels sorted from the worst to the best
+     */
+    std::vector<Level> const &levels() const;
+
+private:
+
+    std::vector<Level> price_levels;
+
+    typename std::vector<Level>::iterator findLevel(Price price);
+
+    Volume unlink(OrderPool &orders, typename std::vector<Level>::iterator it_level, Order const &order);
+};
+
+template<Side side>
+bool price_ladder<side>::better(Price lhs, Price rhs) {
+    return isBetterPrice<side>(lhs, rhs);
+}
+
+template<Side side>
+Volume price_ladder<side>::push(OrderPool &orders, OrderHandle handle) {
+    Price price = orders[handle].price;
+    auto it_level = findLevel(price);
+    if (it_level == price_levels.end() || it_level->price != price) {
+        it_level = price_levels.emplace(it_level, price);
+    }
+    it_level->append(orders, handle);
+    return it_level->volume;
+}
+
+template<Side side>
+OrderHandle price_ladder<side>::top() const {
+    return price_levels.back().head;
+}
+
+template<Side side>
+std::pair<Price, Volume> price_ladder<side>::bestLevel() const {
+    return {price_levels.back().price, price_levels.back().volume};
+}
+
+template<Side side>
+Volume price_ladder<side>::fillTop(OrderPool &orders, Volume volume) {
+    Level &level = price_levels.back();
+    Order &order = orders[level.head];
+    order.volume -= volume;
+    level.volume -= volume;
+    if (order.volume != 0) {
+        return level.volume;
+    }
+    return unlink(orders, std::prev(price_levels.end()), order);
+}
+
+template<Side side>
+Volume price_ladder<side>::setVolume(OrderPool &orders, OrderHandle handle, Volume volume) {
+    Order &order = orders[handle];
+    auto it_level = findLevel(order.price);
+    it_level->volume += volume - order.volume;
+    order.volume = volume;
+    return it_level->volume;
+}
+
+template<Side side>
+Volume price_ladder<side>::remove(OrderPool &orders, OrderHandle handle) {
+    Order const &order = orders[handle];
+    return unlink(orders, findLevel(order.price), order);
+}
+
+template<Side side>
+bool price_ladder<side>::empty() const {
+    return price_levels.empty();
+}
+
+template<Side side>
+template<typename F>
+void price_ladder<side>::forEachLevel(F f) const {
+    for (auto it_level = price_levels.rbegin(); it_level != price_levels.rend(); ++it_level) {
+        if (!f(it_level->price, it_level->volume)) {
+            return;
+        }
+    }
+}
+
+template<Side side>
+template<typename F>
+void price_ladder<side>::forEachOrder(OrderPool const &orders, F f) const {
+    for (auto it_level = price_levels.rbegin(); it_level != price_levels.rend(); ++it_level) {
+        for (OrderHandle handle = it_level->head; handle != NULL_POOL_HANDLE; handle = orders[handle].next) {
+            f(orders[handle]);
+        }
+    }
+}
+
+template<Side side>
+std::vector<typename price_ladder<side>::Level> const &price_ladder<side>::levels() const {
+    return price_levels;
+}
+
+/**
+ * Returns the level with such price, or the position where it has to be inserted
+ */
+template<Side side>
+typename std::vector<typename price_ladder<side>::Level>::iterator price_ladder<side>::findLevel(Price price) {
+    return std::lower_bound(price_levels.begin(), price_levels.end(), price, [](Level const &level, Price price) {
+        return better(price, level.price);
+    });
+}
+
+/**
+ * Removes the order from its level's FIFO and drops the level if it becomes empty.
+ * Returns the new total volume of the level, 0 if it's dropped
+ */
+template<Side side>
+Volume price_ladder<side>::unlink(OrderPool &orders, typename std::vector<Level>::iterator it_level,
+                                  Order const &order) {
+    it_level->unlink(orders, order);
+    if (it_level->empty()) {
+        price_levels.erase(it_level);
+        return 0;
+    }
+    return it_level->volume;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common.hpp"
+#include "pool.hpp"
+
+#include <cstdint>
+
+/**
+ * Type for reference to resting order in {@see OrderPool}
+ */
+typedef PoolHandle OrderHandle;
+
+struct Order {
+    OrderId order_id;
+    Price price; // shifted price
+    Volume volume;
+    uint64_t time;
+
+    /**
+     * Neighbours in the FIFO of the order's price level
+     */
+    OrderHandle prev;
+    OrderHandle next;
+
+    Order() = default;
+
+    Order(OrderId order_id, Price price, Volume volume,
+          uint64_t time) : order_id(order_id), price(price), volume(volume), time(time),
+                           prev(NULL_POOL_HANDLE), next(NULL_POOL_HANDLE) {}
+};
+
+typedef object_pool<Order> OrderPool;
+
+/**
+ * Orders with the same price in their arrival order.
+ * Orders are linked into the FIFO through their `prev` and `next` handles, so the level itself stays small
+ */
+struct PriceLevel {
+    Volume volume = 0; // total volume of the level's orders
+    OrderHandle head = NULL_POOL_HANDLE; // oldest order
+    OrderHandle tail = NULL_POOL_HANDLE; // newest order
+
+    /**
+     * Links the order to the end of the FIFO
+     * O(1) time complexity
+     */
+    void append(OrderPool &orders, OrderHandle handle);
+
+    /**
+     * Unlinks the order from the FIFO, the caller owns its slot then
+     * O(1) time complexity
+     */
+    void unlink(OrderPool &orders, Order const &order);
+
+    /**
+     * `true` if there are no orders on the level
+     */
+    bool empty() const;
+};
+
+inline void PriceLevel::append(OrderPool &orders, OrderHandle handle) {
+    Order &order = orders[handle];
+    order.prev = tail;
+    order.next = NULL_POOL_HANDLE;
+    if (tail == NULL_POOL_HANDLE) {
+        head = handle;
+    } else {
+        orders[tail].next = handle;
+    }
+    tail = handle;
+    volume += order.volume;
+}
+
+inline void PriceLevel::unlink(OrderPool &orders, Order const &order) {
+    if (order.prev == NULL_POOL_HANDLE) {
+        head = order.next;
+    } else {
+        orders[order.prev].next = order.next;
+    }
+    if (order.next == NULL_POOL_HANDLE) {
+        tail = order.prev;
+    } else {
+        orders[order.next].prev = order.prev;
+    }
+    volume -= order.volume;
+}
+
+inline bool PriceLevel::empty() const {
+    return head == NULL_POOL_HANDLE;
+}
@@ -1,12 +1,369 @@
 #include "main.hpp"
 #include "engine.hpp"
 #include "serialize.hpp"
+#include "stream.hpp"
+#include "mapped_file.hpp"
+#include "writer.hpp"
+#include "binary.hpp"
+#include "sharded.hpp"
+#include "pipeline.hpp"
+#include "parallel_parser.hpp"
+#include "snapshot.hpp"
+#include "journal.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
 
 
 std::vector<std::string> run(std::vector<std::string> const &input) {
-    CLOBEngine engine = CLOBEngine();
-    for (auto const &command : parseCommands(input)) {
-        command->accept(&engine);
+    SymbolTable symbols = SymbolTable();
+    TradeCollector trade_collector;
+    CLOBEngine engine = CLOBEngine(&trade_collector);
+    engine.applyBatch(parseCommands(input, symbols));
+    return toString(trade_collector.getTrades(), engine.getOrderBooks(), symbols);
+}
+
+/* command-line driver */
+
+/**
+ * Which part of the output is written
+ */
+enum OutputMode {
+    ALL, TRADES, BOOKS, FEED, NONE
+};
+
+struct Options {
+    std::string input_path;
+    std::string output_path; // stdout if empty
+    std::string encode_path; // if set, commands are converted to the binary format instead of being run
+    OutputMode output_mode = OutputMode::ALL;
+    bool is_stats = false;
+    size_t shards_cnt = 0; // single-threaded engine if 0
+    bool is_pipelined = false;
+    size_t parse_threads_cnt = 1;
+    std::string restore_path; // snapshot to start from, if set
+    std::string snapshot_path; // file to write the final snapshot to, if set
+    std::string journal_path; // journal to replay and append commands to, if set
+    JournalPolicy journal_policy;
+};
+
+/**
+ * Bytes of csv input parsed at once when parsing runs on several threads
+ */
+static size_t const PARALLEL_PARSE_WINDOW = 64 << 20;
+
+static char const *const USAGE =
+        "usage: webbtraders [--output=all|trades|books|feed|none] [--out=<file>] [--stats] [--shards=<n>]\n"
+        "                   [--pipeline] [--parse-threads=<n>] [--restore=<file>] [--snapshot=<file>]\n"
+        "                   [--journal=<file>] [--journal-sync-ms=<n>] [--journal-sync-bytes=<n>]\n"
+        "                   [--encode=<file>] <commands file>\n"
+        "  commands file is either csv or binary written by --encode\n"
+        "  --output  part of the output to write, trades and then order books by default,\n"
+        "            feed writes level updates and trades as they happen\n"
+        "  --out     file to write the output to, stdout by default\n"
+        "  --stats   print throughput statistics to stderr\n"
+        "  --shards  match symbols on n worker threads\n"
+        "  --pipeline  parse, match and format on separate threads at the same time\n"
+        "  --parse-threads  parse csv input on n threads\n"
+        "  --restore   restore the engine from the snapshot before running commands\n"
+        "  --snapshot  write a snapshot of the engine to the file after running commands\n"
+        "  --journal   replay the journal after the restored snapshot, then append commands to it before running them\n"
+        "  --journal-sync-ms     sync the journal at least every n milliseconds, 10 by default\n"
+        "  --journal-sync-bytes  sync the journal when n bytes of commands are pending, 1 MiB by default\n"
+        "  --encode  convert commands to the binary format and write them to the file instead of running them\n";
+
+/**
+ * Prints latency histograms of the engine, if they are compiled in
+ */
+template<typename Engine>
+void printLatencyHistograms(std::ostream &out, Engine const &engine) {
+    if (!LatencyTimer::ENABLED) {
+        return;
+    }
+    for (size_t i = 0; i < LATENCY_KINDS_CNT; ++i) {
+        auto kind = static_cast<LatencyKind>(i);
+        printLatencies(out, latencyKindName(kind), engine.latencyHistogram(kind));
+    }
+}
+
+/**
+ * Parses a positive number of an option
+ */
+size_t parseCount(std::string_view value, char const *what) {
+    size_t count = 0;
+    auto result = std::from_chars(value.data(), value.data() + value.size(), count);
+    if (result.ec != std::errc() || result.ptr != value.data() + value.size() || count == 0) {
+        throw std::invalid_argument("invalid number of " + std::string(what) + " " + std::string(value));
+    }
+    return count;
+}
+
+Options parseOptions(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--output=all") {
+            options.output_mode = OutputMode::ALL;
+        } else if (arg == "--output=trades") {
+            options.output_mode = OutputMode::TRADES;
+        } else if (arg == "--output=books") {
+            options.output_mode = OutputMode::BOOKS;
+        } else if (arg == "--output=feed") {
+            options.output_mode = OutputMode::FEED;
+        } else if (arg == "--output=none") {
+            options.output_mode = OutputMode::NONE;
+        } else if (arg.substr(0, 6) == "--out=") {
+            options.output_path = arg.substr(6);
+        } else if (arg.substr(0, 9) == "--encode=") {
+            options.encode_path = arg.substr(9);
+        } else if (arg.substr(0, 9) == "--shards=") {
+            options.shards_cnt = parseCount(arg.substr(9), "shards");
+        } else if (arg.substr(0, 16) == "--parse-threads=") {
+            options.parse_threads_cnt = parseCount(arg.substr(16), "parse threads");
+        } else if (arg.substr(0, 10) == "--restore=") {
+            options.restore_path = arg.substr(10);
+        } else if (arg.substr(0, 11) == "--snapshot=") {
+            options.snapshot_path = arg.substr(11);
+        } else if (arg.substr(0, 10) == "--journal=") {
+            options.journal_path = arg.substr(10);
+        } else if (arg.substr(0, 18) == "--journal-sync-ms=") {
+            options.journal_policy.sync_interval = std::chrono::milliseconds(parseCount(arg.substr(18), "ms"));
+        } else if (arg.substr(0, 21) == "--journal-sync-bytes=") {
+            options.journal_policy.sync_size = parseCount(arg.substr(21), "bytes");
+        } else if (arg == "--pipeline") {
+            options.is_pipelined = true;
+        } else if (arg == "--stats") {
+            options.is_stats = true;
+        } else if (arg.substr(0, 2) != "--" && options.input_path.empty()) {
+            options.input_path = arg;
+        } else {
+            throw std::invalid_argument("unexpected argument " + std::string(arg));
+        }
+    }
+    if (options.is_pipelined && options.shards_cnt != 0) {
+        throw std::invalid_argument("--pipeline and --shards can't be combined");
+    }
+    bool is_snapshot_used = !options.restore_path.empty() || !options.snapshot_path.empty();
+    if (is_snapshot_used && (options.is_pipelined || options.shards_cnt != 0)) {
+        throw std::invalid_argument("snapshots are only supported by the single-threaded engine");
+    }
+    if (options.output_mode == OutputMode::FEED && (options.is_pipelined || options.shards_cnt != 0)) {
+        throw std::invalid_argument("feed is only supported by the single-threaded engine");
+    }
+    if (!options.journal_path.empty() && options.is_pipelined) {
+        throw std::invalid_argument("--pipeline and --journal can't be combined");
+    }
+    if (options.parse_threads_cnt > 1 && options.is_pipelined) {
+        throw std::invalid_argument("--pipeline and --parse-threads can't be combined");
+    }
+    if (options.input_path.empty()) {
+        throw std::invalid_argument("commands file is not specified");
+    }
+    return options;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (std::invalid_argument const &e) {
+        std::cerr << e.what() << '\n' << USAGE;
+        return 2;
+    }
+
+    try {
+        typedef std::chrono::steady_clock Clock;
+        Clock::duration parse_duration{}, match_duration{}, output_duration{};
+
+        MappedFile file(options.input_path);
+        // the kind of input is only known once it's mapped
+        if (options.parse_threads_cnt > 1 && isBinaryCommands(file.data())) {
+            throw std::invalid_argument("--parse-threads only applies to csv commands");
+        }
+
+        if (!options.encode_path.empty()) {
+            SymbolTable symbols = SymbolTable();
+            Commands commands;
+            parseCommands(file.data(), symbols, commands);
+            std::string encoded;
+            encodeCommands(commands, symbols, encoded);
+            BufferedWriter encoded_writer(options.encode_path);
+            encoded_writer.write(encoded);
+            encoded_writer.flush();
+            return 0;
+        }
+
+        auto writer = options.output_path.empty()
+                      ? std::make_unique<BufferedWriter>(STDOUT_FILENO)
+                      : std::make_unique<BufferedWriter>(options.output_path);
+        bool is_trades_written = options.output_mode == OutputMode::ALL || options.output_mode == OutputMode::TRADES;
+        bool is_books_written = options.output_mode == OutputMode::ALL || options.output_mode == OutputMode::BOOKS;
+
+        if (options.is_pipelined) {
+            auto start = Clock::now();
+            PipelineCounts counts = runPipeline(file.data(), *writer, is_trades_written, is_books_written);
+            writer->flush();
+            if (options.is_stats) {
+                double total = std::chrono::duration<double>(Clock::now() - start).count();
+                std::cerr << "commands: " << counts.commands_cnt << ", trades: " << counts.trades_cnt
+                          << ", input: " << file.data().size() << " bytes, output: " << writer->written() << " bytes\n"
+                          << "total: " << total << " s\n"
+                          << "throughput: " << (total > 0 ? counts.commands_cnt / total : 0) << " commands/s, "
+                          << (total > 0 ? file.data().size() / total / (1 << 20) : 0) << " MiB/s\n";
+            }
+            return 0;
+        }
+
+        SymbolTable symbols = SymbolTable();
+        std::string text;
+        TradeFormatter trade_formatter(text, symbols);
+        FeedFormatter feed_formatter(text, symbols);
+        bool is_feed_written = options.output_mode == OutputMode::FEED;
+        std::unique_ptr<CLOBEngine> engine;
+        std::unique_ptr<ShardedEngine> sharded_engine;
+        if (options.shards_cnt == 0) {
+            engine = is_feed_written ? std::make_unique<CLOBEngine>(&feed_formatter, 1 << 16, &feed_formatter)
+                                     : std::make_unique<CLOBEngine>(&trade_formatter);
+        } else {
+            sharded_engine = std::make_unique<ShardedEngine>(options.shards_cnt, &trade_formatter);
+        }
+        Commands commands;
+        commands.reserve(STREAM_BATCH_SIZE);
+        size_t commands_cnt = 0;
+        uint64_t applied_cnt = 0; // including commands of the snapshot and the journal
+        size_t replayed_trades_cnt = 0;
+        if (!options.restore_path.empty()) {
+            MappedFile snapshot(options.restore_path);
+            applied_cnt = restoreSnapshot(snapshot.data(), *engine, symbols);
+        }
+        std::unique_ptr<JournalWriter> journal_writer;
+        std::unique_ptr<JournaledOutput> journaled_output;
+        if (!options.journal_path.empty()) {
+            // trades of the replayed commands were reported by the run which journaled them
+            JournalReader journal_reader(options.journal_path, symbols, applied_cnt);
+            while (journal_reader.read(commands)) {
+                if (engine) {
+                    engine->applyBatch(commands);
+                } else {
+                    sharded_engine->apply(commands);
+                }
+                commands.clear();
+                text.clear();
+            }
+            applied_cnt = journal_reader.position().sequence;
+            replayed_trades_cnt = trade_formatter.count() + feed_formatter.count();
+            journal_writer = std::make_unique<JournalWriter>(options.journal_path, symbols, journal_reader.position(),
+                                                             options.journal_policy);
+            journaled_output = std::make_unique<JournaledOutput>(*journal_writer, *writer);
+        }
+        std::unique_ptr<ParallelParser> parallel_parser;
+        if (options.parse_threads_cnt > 1) {
+            parallel_parser = std::make_unique<ParallelParser>(options.parse_threads_cnt);
+        }
+
+        std::string_view input = file.data();
+        std::unique_ptr<BinaryCommandReader> binary_reader;
+        if (isBinaryCommands(input)) {
+            binary_reader = std::make_unique<BinaryCommandReader>(input, symbols);
+            input = std::string_view();
+        }
+        // a window of the parallel parser is applied in batches, so its output doesn't pile up
+        Commands parsed;
+        size_t parsed_offset = 0;
+        while (!input.empty() || parsed_offset < parsed.size() || (binary_reader && !binary_reader->empty())) {
+            auto parse_start = Clock::now();
+            commands.clear();
+            if (binary_reader) {
+                binary_reader->read(commands, STREAM_BATCH_SIZE);
+            } else if (parallel_parser) {
+                if (parsed_offset == parsed.size()) {
+                    parsed.clear();
+                    parsed_offset = 0;
+                    parallel_parser->parse(nextChunk(input, PARALLEL_PARSE_WINDOW), symbols, parsed);
+                }
+                size_t batch_size = std::min(STREAM_BATCH_SIZE, parsed.size() - parsed_offset);
+                commands.assign(parsed.begin() + parsed_offset, parsed.begin() + parsed_offset + batch_size);
+                parsed_offset += batch_size;
+            } else {
+                while (!input.empty() && commands.size() < STREAM_BATCH_SIZE) {
+                    parseCommand(nextLine(input), symbols, commands);
+                }
+            }
+            auto match_start = Clock::now();
+            if (journal_writer) {
+                journal_writer->append(commands);
+            }
+            if (engine) {
+                engine->applyBatch(commands);
+            } else {
+                sharded_engine->apply(commands);
+            }
+            auto output_start = Clock::now();
+            if (is_trades_written || is_feed_written) {
+                if (journaled_output) {
+                    // output can't run ahead of the journal, a crash would take back published trades
+                    journaled_output->write(text);
+                } else {
+                    writer->write(text);
+                }
+            }
+            text.clear();
+            auto output_end = Clock::now();
+
+            parse_duration += match_start - parse_start;
+            match_duration += output_start - match_start;
+            output_duration += output_end - output_start;
+            commands_cnt += commands.size();
+            applied_cnt += commands.size();
+        }
+        if (journaled_output) {
+            journaled_output->flush();
+        }
+
+        auto books_start = Clock::now();
+        if (is_books_written) {
+            appendOrderBooks(text, engine ? engine->getOrderBooks() : sharded_engine->getOrderBooks(), symbols);
+            writer->write(text);
+        }
+        writer->flush();
+        output_duration += Clock::now() - books_start;
+
+        if (!options.snapshot_path.empty()) {
+            std::string snapshot;
+            writeSnapshot(*engine, symbols, snapshot, applied_cnt);
+            BufferedWriter snapshot_writer(options.snapshot_path);
+            snapshot_writer.write(snapshot);
+            snapshot_writer.flush();
+        }
+
+        if (options.is_stats) {
+            auto seconds = [](Clock::duration duration) {
+                return std::chrono::duration<double>(duration).count();
+            };
+            double total = seconds(parse_duration + match_duration + output_duration);
+            size_t trades_cnt = trade_formatter.count() + feed_formatter.count() - replayed_trades_cnt;
+            std::cerr << "commands: " << commands_cnt << ", trades: " << trades_cnt
+                      << ", input: " << file.data().size() << " bytes, output: " << writer->written() << " bytes\n"
+                      << "parse: " << seconds(parse_duration) << " s, match: " << seconds(match_duration)
+                      << " s, output: " << seconds(output_duration) << " s\n"
+                      << "throughput: " << (total > 0 ? commands_cnt / total : 0) << " commands/s, "
+                      << (total > 0 ? file.data().size() / total / (1 << 20) : 0) << " MiB/s\n";
+        }
+        if (engine) {
+            printLatencyHistograms(std::cerr, *engine);
+        } else {
+            printLatencyHistograms(std::cerr, *sharded_engine);
+        }
+    } catch (std::invalid_argument const &e) {
+        std::cerr << e.what() << '\n' << USAGE;
+        return 2;
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
     }
-    return toString(engine.getTrades(), engine.getOrderBooks());
-}
\ No newline at end of file
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(std::string const &path) : address(nullptr), size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("can't open " + path);
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) < 0) {
+        close(fd);
+        throw std::runtime_error("can't stat " + path);
+    }
+    size = static_cast<size_t>(file_stat.st_size);
+    // empty files can't be mapped, they are represented by empty data
+    if (size > 0) {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("can't map " + path);
+        }
+        // the file is read once from the beginning to the end
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        address = static_cast<char const *>(mapped);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (address != nullptr) {
+        munmap(const_cast<char *>(address), size);
+    }
+}
+
+std::string_view MappedFile::data() const {
+    return {address, size};
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/**
+ * Read-only memory mapping of a whole file. Contents are read straight from the mapped pages without copying
+ */
+class MappedFile {
+public:
+
+    /**
+     * Maps the file, throws std::runtime_error if the file can't be opened or mapped
+     */
+    explicit MappedFile(std::string const &path);
+
+    MappedFile(MappedFile const &) = delete;
+
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    ~MappedFile();
+
+    /**
+     * Contents of the file, valid while the mapping exists
+     */
+    std::string_view data() const;
+
+private:
+
+    char const *address;
+    size_t size;
+};
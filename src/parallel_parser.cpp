@@ -0,0 +1,124 @@
+#include "parallel_parser.hpp"
+#include "serialize.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+std::string_view nextChunk(std::string_view &input, size_t size) {
+    size_t end = input.find('\n', std::min(size, input.size()));
+    end = end == std::string_view::npos ? input.size() : end + 1;
+    std::string_view chunk = input.substr(0, end);
+    input.remove_prefix(end);
+    return chunk;
+}
+
+/* ParallelParser definition */
+
+ParallelParser::ParallelParser(size_t threads_cnt) : result(nullptr), stage(Stage::PARSE), next_chunk(0),
+                                                     generation(0), busy_cnt(0), is_stopped(false) {
+    if (threads_cnt == 0) {
+        throw std::runtime_error("number of parser threads must be positive");
+    }
+    for (size_t i = 1; i < threads_cnt; ++i) {
+        workers.emplace_back(&ParallelParser::work, this);
+    }
+}
+
+ParallelParser::~ParallelParser() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopped = true;
+    }
+    work_cv.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ParallelParser::parse(std::string_view input, SymbolTable &symbols, Commands &commands) {
+    chunks.clear();
+    while (!input.empty()) {
+        chunks.emplace_back();
+        chunks.back().text = nextChunk(input, CHUNK_SIZE);
+    }
+    runStage(Stage::PARSE);
+
+    // symbols are interned in the order they first appear in the input, as a sequential parser would do
+    size_t commands_cnt = commands.size();
+    for (Chunk &chunk : chunks) {
+        if (chunk.error) {
+            std::rethrow_exception(chunk.error);
+        }
+        for (SymbolId symbol = 0; symbol < chunk.symbols.size(); ++symbol) {
+            chunk.symbol_ids.push_back(symbols.intern(chunk.symbols.name(symbol)));
+        }
+        chunk.offset = commands_cnt;
+        commands_cnt += chunk.commands.size();
+    }
+
+    commands.resize(commands_cnt);
+    result = &commands;
+    runStage(Stage::COPY);
+    result = nullptr;
+}
+
+/* ParallelParser implementation details */
+
+void ParallelParser::work() {
+    size_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [&] { return generation != seen_generation || is_stopped; });
+            if (is_stopped) {
+                return;
+            }
+            seen_generation = generation;
+        }
+        processChunks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy_cnt;
+        }
+        done_cv.notify_one();
+    }
+}
+
+void ParallelParser::runStage(Stage new_stage) {
+    stage = new_stage;
+    next_chunk.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+        busy_cnt = workers.size();
+    }
+    work_cv.notify_all();
+    processChunks();
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return busy_cnt == 0; });
+}
+
+void ParallelParser::processChunks() {
+    size_t i;
+    while ((i = next_chunk.fetch_add(1, std::memory_order_relaxed)) < chunks.size()) {
+        Chunk &chunk = chunks[i];
+        switch (stage) {
+            case Stage::PARSE:
+                try {
+                    parseCommands(chunk.text, chunk.symbols, chunk.commands);
+                } catch (...) {
+                    chunk.error = std::current_exception();
+                }
+                break;
+            case Stage::COPY:
+                for (size_t j = 0; j < chunk.commands.size(); ++j) {
+                    Command &command = (*result)[chunk.offset + j];
+                    command = chunk.commands[j];
+                    if (auto insert = std::get_if<Insert>(&command)) {
+                        insert->symbol = chunk.symbol_ids[insert->symbol];
+                    }
+                }
+                break;
+        }
+    }
+}
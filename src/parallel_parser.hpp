@@ -0,0 +1,89 @@
+#pragma once
+
+#include "common.hpp"
+#include "symbols.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * Cuts about `size` bytes from the beginning of `input`, extended to the end of the line
+ */
+std::string_view nextChunk(std::string_view &input, size_t size);
+
+/**
+ * Parses newline-separated commands on several threads.
+ * The input is cut into chunks at line boundaries, every chunk is parsed with its own symbol table,
+ * then chunks are concatenated in input order and their symbols are interned in the same order,
+ * so the result is exactly what {@see parseCommands} would return
+ */
+class ParallelParser {
+public:
+
+    /**
+     * Bytes of input parsed by one thread at once
+     */
+    static size_t const CHUNK_SIZE = 1 << 20;
+
+    /**
+     * @param threads_cnt - number of threads including the calling one
+     */
+    explicit ParallelParser(size_t threads_cnt);
+
+    ParallelParser(ParallelParser const &) = delete;
+
+    ParallelParser &operator=(ParallelParser const &) = delete;
+
+    ~ParallelParser();
+
+    /**
+     * Parses `input` and appends the commands to `commands`, symbols are interned into `symbols`.
+     * If some lines are invalid, the error of the first one is rethrown and nothing is appended
+     */
+    void parse(std::string_view input, SymbolTable &symbols, Commands &commands);
+
+private:
+
+    struct Chunk {
+        std::string_view text;
+        SymbolTable symbols;
+        Commands commands;
+        std::vector<SymbolId> symbol_ids; // identifiers of the chunk's symbols in the caller's table
+        size_t offset; // position of the chunk's first command in the result
+        std::exception_ptr error;
+    };
+
+    enum class Stage {
+        PARSE, COPY
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Chunk> chunks;
+    Commands *result;
+    Stage stage;
+    std::atomic<size_t> next_chunk;
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    size_t generation; // incremented for every stage, so workers know there is new work
+    size_t busy_cnt;
+    bool is_stopped;
+
+    void work();
+
+    /**
+     * Runs the stage on all threads and waits for them
+     */
+    void runStage(Stage new_stage);
+
+    /**
+     * Processes chunks until none is left
+     */
+    void processChunks();
+};
@@ -0,0 +1,237 @@
+#include "pipeline.hpp"
+#include "engine.hpp"
+#include "serialize.hpp"
+#include "binary.hpp"
+#include "ring.hpp"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* pipeline helpers */
+
+/**
+ * Names of symbols interned by the parser, so the formatter can resolve them while the parser keeps interning.
+ * Names are published before the commands using them are pushed, and new symbols are rare,
+ * so the formatter takes the lock only when it sees an unknown symbol
+ */
+class PublishedSymbols {
+public:
+
+    /**
+     * Publishes symbols which were interned since the last call. Parser only
+     */
+    void publish(SymbolTable const &symbols);
+
+    /**
+     * Copies published names to `symbols` until it knows the symbol. Formatter only
+     */
+    void resolve(SymbolTable &symbols, SymbolId symbol);
+
+private:
+
+    std::mutex mutex;
+    std::vector<Symbol> names;
+    size_t published_cnt = 0; // parser's copy of `names.size()`
+};
+
+void PublishedSymbols::publish(SymbolTable const &symbols) {
+    if (published_cnt == symbols.size()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (; published_cnt < symbols.size(); ++published_cnt) {
+        names.push_back(symbols.name(published_cnt));
+    }
+}
+
+void PublishedSymbols::resolve(SymbolTable &symbols, SymbolId symbol) {
+    if (symbol < symbols.size()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    while (symbols.size() < names.size()) {
+        symbols.intern(names[symbols.size()]);
+    }
+}
+
+/**
+ * Collects trades of the matcher and passes them to the formatter in batches
+ */
+class TradeBatcher : public TradeListener {
+public:
+
+    explicit TradeBatcher(spsc_ring<Trade> &ring) : ring(ring), trades_cnt(0) {
+        trades.reserve(PIPELINE_BATCH_SIZE);
+    }
+
+    void onTrade(Trade const &trade) override {
+        trades.push_back(trade);
+        if (trades.size() == PIPELINE_BATCH_SIZE) {
+            flush();
+        }
+    }
+
+    void flush() {
+        ring.push(trades.data(), trades.size());
+        trades_cnt += trades.size();
+        trades.clear();
+    }
+
+    size_t count() const {
+        return trades_cnt;
+    }
+
+private:
+
+    spsc_ring<Trade> &ring;
+    std::vector<Trade> trades;
+    size_t trades_cnt;
+};
+
+/**
+ * Threads of the parser and the formatter, which are stopped and joined when the matcher leaves the pipeline,
+ * also by an exception, so neither of them outlives it or waits forever for it
+ */
+class PipelineStages {
+public:
+
+    std::thread parser;
+    std::thread formatter;
+
+    PipelineStages(spsc_ring<Command> &command_ring,
+                   spsc_ring<Trade> &trade_ring) : command_ring(command_ring), trade_ring(trade_ring),
+                                                   is_stopped(false) {}
+
+    PipelineStages(PipelineStages const &) = delete;
+
+    PipelineStages &operator=(PipelineStages const &) = delete;
+
+    ~PipelineStages() {
+        join();
+    }
+
+    /**
+     * `true` once the matcher stopped, the parser doesn't push more commands then
+     */
+    bool stopped() const {
+        return is_stopped.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Closes the trade ring and waits for both threads. Matcher only
+     */
+    void join() {
+        is_stopped.store(true, std::memory_order_relaxed);
+        trade_ring.close();
+        if (parser.joinable()) {
+            // a parser waiting for room in the ring gets it, then sees the stop and closes the ring
+            Command command;
+            while (command_ring.pop(&command, 1) != 0) {
+            }
+            parser.join();
+        }
+        if (formatter.joinable()) {
+            formatter.join();
+        }
+    }
+
+private:
+
+    spsc_ring<Command> &command_ring;
+    spsc_ring<Trade> &trade_ring;
+    std::atomic<bool> is_stopped;
+};
+
+/* runPipeline definition */
+
+PipelineCounts runPipeline(std::string_view input, BufferedWriter &output,
+                           bool is_trades_written, bool is_books_written) {
+    SymbolTable symbols = SymbolTable();
+    PublishedSymbols published_symbols;
+    spsc_ring<Command> command_ring(PIPELINE_RING_CAPACITY);
+    spsc_ring<Trade> trade_ring(PIPELINE_RING_CAPACITY);
+    std::exception_ptr parse_error, format_error;
+    PipelineStages stages(command_ring, trade_ring);
+
+    stages.parser = std::thread([&]() {
+        try {
+            std::unique_ptr<BinaryCommandReader> binary_reader;
+            if (isBinaryCommands(input)) {
+                binary_reader = std::make_unique<BinaryCommandReader>(input, symbols);
+                input = std::string_view();
+            }
+            Commands commands;
+            commands.reserve(PIPELINE_BATCH_SIZE);
+            while ((!input.empty() || (binary_reader && !binary_reader->empty())) && !stages.stopped()) {
+                commands.clear();
+                if (binary_reader) {
+                    binary_reader->read(commands, PIPELINE_BATCH_SIZE);
+                }
+                while (!input.empty() && commands.size() < PIPELINE_BATCH_SIZE) {
+                    parseCommand(nextLine(input), symbols, commands);
+                }
+                published_symbols.publish(symbols);
+                command_ring.push(commands.data(), commands.size());
+            }
+        } catch (...) {
+            parse_error = std::current_exception();
+        }
+        command_ring.close();
+    });
+
+    stages.formatter = std::thread([&]() {
+        SymbolTable formatter_symbols = SymbolTable();
+        std::vector<Trade> trades(PIPELINE_BATCH_SIZE);
+        std::string text;
+        size_t trades_cnt;
+        while ((trades_cnt = trade_ring.pop(trades.data(), trades.size())) != 0) {
+            // after a failure trades are still drained, so the matcher never waits for a stopped formatter
+            if (!is_trades_written || format_error) {
+                continue;
+            }
+            try {
+                for (size_t i = 0; i < trades_cnt; ++i) {
+                    published_symbols.resolve(formatter_symbols, trades[i].symbol);
+                    appendTrade(text, trades[i], formatter_symbols);
+                }
+                output.write(text);
+                text.clear();
+            } catch (...) {
+                format_error = std::current_exception();
+            }
+        }
+    });
+
+    PipelineCounts counts;
+    TradeBatcher trade_batcher(trade_ring);
+    CLOBEngine engine = CLOBEngine(&trade_batcher);
+    std::vector<Command> commands(PIPELINE_BATCH_SIZE);
+    size_t commands_cnt;
+    while ((commands_cnt = command_ring.pop(commands.data(), commands.size())) != 0) {
+        for (size_t i = 0; i < commands_cnt; ++i) {
+            engine.apply(commands[i]);
+        }
+        // trades are passed on after every batch, so the formatter isn't held back by a quiet market
+        trade_batcher.flush();
+        counts.commands_cnt += commands_cnt;
+    }
+    stages.join();
+    counts.trades_cnt = trade_batcher.count();
+
+    if (parse_error) {
+        std::rethrow_exception(parse_error);
+    }
+    if (format_error) {
+        std::rethrow_exception(format_error);
+    }
+    if (is_books_written) {
+        std::string text;
+        appendOrderBooks(text, engine.getOrderBooks(), symbols);
+        output.write(text);
+    }
+    return counts;
+}
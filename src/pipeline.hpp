@@ -0,0 +1,30 @@
+#pragma once
+
+#include "writer.hpp"
+
+#include <string_view>
+
+/**
+ * Number of commands or trades moved between pipeline stages at once
+ */
+static size_t const PIPELINE_BATCH_SIZE = 1024;
+
+/**
+ * Capacity of the rings between pipeline stages, in commands or trades
+ */
+static size_t const PIPELINE_RING_CAPACITY = 1 << 16;
+
+struct PipelineCounts {
+    size_t commands_cnt = 0;
+    size_t trades_cnt = 0;
+};
+
+/**
+ * Runs commands like the command-line driver, but parsing, matching and formatting of trades overlap:
+ * a parser thread, the calling thread as the matcher and a formatter thread are connected by bounded
+ * {@see spsc_ring} queues, so the run takes about as long as its slowest stage.
+ * `input` is either csv or binary commands, order books are written after all trades.
+ * Parse errors are rethrown by the calling thread once the stages have stopped
+ */
+PipelineCounts runPipeline(std::string_view input, BufferedWriter &output,
+                           bool is_trades_written = true, bool is_books_written = true);
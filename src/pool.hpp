@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Type for reference to object allocated in {@see object_pool}
+ */
+typedef uint32_t PoolHandle;
+
+/**
+ * Handle which doesn't reference any object
+ */
+static constexpr PoolHandle NULL_POOL_HANDLE = std::numeric_limits<PoolHandle>::max();
+
+/**
+ * Pool of objects allocated in fixed-size slabs.
+ * Objects never move while they are allocated, released slots are reused by the following allocations,
+ * so memory is only requested from the system when the number of live objects grows
+ */
+template<typename T, size_t SlabBits = 12>
+class object_pool {
+
+public:
+
+    /**
+     * Places the value to a free slot and returns handle of the slot
+     * O(1) time complexity
+     */
+    PoolHandle allocate(T const &value);
+
+    /**
+     * Releases the slot, handle mustn't be used after that
+     * O(1) time complexity
+     */
+    void free(PoolHandle handle);
+
+    /**
+     * Returns the object by its handle
+     * O(1) time complexity
+     */
+    T &operator[](PoolHandle handle);
+
+    T const &operator[](PoolHandle handle) const;
+
+    /**
+     * Hints the processor to load the object, so a following access doesn't wait for memory
+     */
+    void prefetch(PoolHandle handle) const;
+
+    /**
+     * Number of allocated objects
+     */
+    size_t size() const;
+
+private:
+
+    static constexpr size_t SLAB_SIZE = size_t(1) << SlabBits;
+
+    std::vector<std::unique_ptr<T[]>> slabs;
+
+    /**
+     * Stack of released slots
+     */
+    std::vector<PoolHandle> free_handles;
+
+    /**
+     * Slots starting from this one have never been allocated
+     */
+    PoolHandle next_handle = 0;
+};
+
+template<typename T, size_t SlabBits>
+PoolHandle object_pool<T, SlabBits>::allocate(T const &value) {
+    PoolHandle handle;
+    if (!free_handles.empty()) {
+        handle = free_handles.back();
+        free_handles.pop_back();
+    } else {
+        if (next_handle == slabs.size() * SLAB_SIZE) {
+            slabs.emplace_back(new T[SLAB_SIZE]);
+        }
+        handle = next_handle++;
+    }
+    (*this)[handle] = value;
+    return handle;
+}
+
+template<typename T, size_t SlabBits>
+void object_pool<T, SlabBits>::free(PoolHandle handle) {
+    free_handles.push_back(handle);
+}
+
+template<typename T, size_t SlabBits>
+T &object_pool<T, SlabBits>::operator[](PoolHandle handle) {
+    return slabs[handle >> SlabBits][handle & (SLAB_SIZE - 1)];
+}
+
+template<typename T, size_t SlabBits>
+T const &object_pool<T, SlabBits>::operator[](PoolHandle handle) const {
+    return slabs[handle >> SlabBits][handle & (SLAB_SIZE - 1)];
+}
+
+template<typename T, size_t SlabBits>
+void object_pool<T, SlabBits>::prefetch(PoolHandle handle) const {
+    __builtin_prefetch(&(*this)[handle]);
+}
+
+template<typename T, size_t SlabBits>
+size_t object_pool<T, SlabBits>::size() const {
+    return next_handle - free_handles.size();
+}
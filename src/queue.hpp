@@ -1,14 +1,21 @@
 #pragma once
 
+#include "flat_hash_map.hpp"
+
 #include <vector>
-#include <unordered_map>
+#include <utility>
+#include <cstdint>
 #include <functional>
 
 /**
  * This queue supports fast operations with values using their keys.
- * Keys can be represented as unique identifiers of values, which are used for searching
+ * Keys can be represented as unique identifiers of values, which are used for searching.
+ * With `LazyRemoval` removed elements which aren't on top are only marked as dead and left in place,
+ * so a removal costs O(1) instead of sifting. Dead elements are dropped when they reach the top, and the heap
+ * is rebuilt without them once their share exceeds `max_dead_share`. It pays off when most removed
+ * elements are deep in the heap, e.g. cancels of orders far from the best price
  */
-template<typename Key, typename Value, class Compare>
+template<typename Key, typename Value, class Compare, bool LazyRemoval = false>
 class priority_queue {
 
 public:
@@ -18,8 +25,9 @@ public:
 
     /**
      * @param value_to_key - mapping from values to keys
+     * @param max_dead_share - share of dead elements which triggers rebuilding of the heap, used with `LazyRemoval`
      */
-    priority_queue(std::function<Key(Value)> const &value_to_key);
+    priority_queue(std::function<Key(Value)> const &value_to_key, double max_dead_share = 0.5);
 
     /**
      * Inserts the element to the queue.
@@ -33,6 +41,8 @@ public:
      */
     Value &top();
 
+    Value const &top() const;
+
     /**
      * If element with such key exists in the queue returns the iterator pointing at it.
      * Otherwise, returns iterator the end of queue {@see end()}
@@ -42,13 +52,13 @@ public:
 
     /**
      * If iterator is valid, removes the element from queue
-     * O(log(n)) time complexity
+     * O(log(n)) time complexity, O(1) amortized with `LazyRemoval` unless the element is on top
      */
     void remove(iterator it);
 
     /**
      * Removes the minimum element from queue. To get the minimum element {@see top()}
-     * O(log(n)) time complexity
+     * O(log(n)) time complexity, plus dropping of dead elements which reach the top with `LazyRemoval`
      */
     void pop();
 
@@ -56,7 +66,14 @@ public:
      * `true` if there are no elements in the queue, `false` otherwise
      * O(1) time complexity
      */
-    bool empty();
+    bool empty() const;
+
+    /**
+     * Calls `f(value)` for every element in heap order, not in sorted one. Dead elements are skipped
+     * O(n) time complexity
+     */
+    template<typename F>
+    void forEach(F f) const;
 
     /**
      * Return iterator to the queue end
@@ -72,29 +89,51 @@ private:
 
     std::vector<Value> values;
     std::function<Key(Value)> const value_to_key;
-    std::unordered_map<Key, size_t> key_indexes;
+    flat_hash_map<Key, size_t> key_indexes;
     Compare cmp;
 
+    /**
+     * Marks of removed elements left in the heap, only used with `LazyRemoval`.
+     * The top element is never dead, so `top()` and `empty()` don't have to look for live elements.
+     * Keys of dead elements aren't in `key_indexes`, so they can be reused by new elements
+     */
+    std::vector<uint8_t> dead_flags;
+    size_t dead_cnt = 0;
+    double max_dead_share;
+
+    bool isDead(size_t index) const;
+
     void siftUp(size_t index_from);
 
     void siftDown(size_t index_from);
 
+    template<typename Swap>
+    void siftDown(size_t index_from, Swap swap_values);
+
     void remove(size_t index_from);
 
     void swap(size_t index_from, size_t index_to);
+
+    void dropDeadTop();
+
+    void compact();
 };
 
-template<typename Key, typename Value, class Compare>
-priority_queue<Key, Value, Compare>::priority_queue(std::function<Key(Value)> const &value_to_key) :
-        value_to_key(value_to_key) {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+priority_queue<Key, Value, Compare, LazyRemoval>::priority_queue(std::function<Key(Value)> const &value_to_key,
+                                                                 double max_dead_share) :
+        value_to_key(value_to_key), max_dead_share(max_dead_share) {
     cmp = Compare();
     values = std::vector<Value>();
-    key_indexes = std::unordered_map<Key, size_t>();
+    key_indexes = flat_hash_map<Key, size_t>();
 }
 
-template<typename Key, typename Value, class Compare>
-void priority_queue<Key, Value, Compare>::push(Value const &value) {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::push(Value const &value) {
     values.push_back(value);
+    if constexpr (LazyRemoval) {
+        dead_flags.push_back(false);
+    }
     size_t index_back = values.size() - 1;
     key_indexes[value_to_key(value)] = index_back;
     if (index_back > 0) {
@@ -102,55 +141,104 @@ void priority_queue<Key, Value, Compare>::push(Value const &value) {
     }
 }
 
-template<typename Key, typename Value, class Compare>
-Value &priority_queue<Key, Value, Compare>::top() {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+Value &priority_queue<Key, Value, Compare, LazyRemoval>::top() {
+    return *values.begin();
+}
+
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+Value const &priority_queue<Key, Value, Compare, LazyRemoval>::top() const {
     return *values.begin();
 }
 
-template<typename Key, typename Value, class Compare>
-typename priority_queue<Key, Value, Compare>::iterator priority_queue<Key, Value, Compare>::find(Key key) {
-    auto it = key_indexes.find(key);
-    if (it == key_indexes.end()) {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+typename priority_queue<Key, Value, Compare, LazyRemoval>::iterator
+priority_queue<Key, Value, Compare, LazyRemoval>::find(Key key) {
+    size_t const *index = key_indexes.find(key);
+    if (index == nullptr) {
         return end();
     }
-    return values.begin() + it->second;
+    return values.begin() + *index;
 }
 
-template<typename Key, typename Value, class Compare>
-void priority_queue<Key, Value, Compare>::pop() {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::pop() {
     remove(0);
+    dropDeadTop();
 }
 
-template<typename Key, typename Value, class Compare>
-void priority_queue<Key, Value, Compare>::remove(priority_queue::iterator it) {
-    remove(it - values.begin());
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::remove(priority_queue::iterator it) {
+    size_t index = it - values.begin();
+    if constexpr (LazyRemoval) {
+        if (index != 0) {
+            key_indexes.erase(value_to_key(values[index]));
+            dead_flags[index] = true;
+            ++dead_cnt;
+            if (dead_cnt > max_dead_share * values.size()) {
+                compact();
+            }
+            return;
+        }
+    }
+    remove(index);
+    dropDeadTop();
 }
 
-template<typename Key, typename Value, class Compare>
-bool priority_queue<Key, Value, Compare>::empty() {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+bool priority_queue<Key, Value, Compare, LazyRemoval>::empty() const {
     return values.empty();
 }
 
-template<typename Key, typename Value, class Compare>
-typename priority_queue<Key, Value, Compare>::iterator priority_queue<Key, Value, Compare>::end() {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+template<typename F>
+void priority_queue<Key, Value, Compare, LazyRemoval>::forEach(F f) const {
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (!isDead(i)) {
+            f(values[i]);
+        }
+    }
+}
+
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+typename priority_queue<Key, Value, Compare, LazyRemoval>::iterator
+priority_queue<Key, Value, Compare, LazyRemoval>::end() {
     return values.end();
 }
 
-template<typename Key, typename Value, class Compare>
-typename priority_queue<Key, Value, Compare>::const_iterator priority_queue<Key, Value, Compare>::end() const {
-    return end();
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+typename priority_queue<Key, Value, Compare, LazyRemoval>::const_iterator
+priority_queue<Key, Value, Compare, LazyRemoval>::end() const {
+    return values.end();
 }
 
-template<typename Key, typename Value, class Compare>
-void priority_queue<Key, Value, Compare>::siftUp(size_t index_from) {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+bool priority_queue<Key, Value, Compare, LazyRemoval>::isDead(size_t index) const {
+    if constexpr (LazyRemoval) {
+        return dead_flags[index];
+    } else {
+        return false;
+    }
+}
+
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::siftUp(size_t index_from) {
     while (index_from > 0 && cmp(values[index_from], values[(index_from - 1) / 2])) {
         swap(index_from, (index_from - 1) / 2);
         index_from = (index_from - 1) / 2;
     }
 }
 
-template<typename Key, typename Value, class Compare>
-void priority_queue<Key, Value, Compare>::siftDown(size_t index_from) {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::siftDown(size_t index_from) {
+    siftDown(index_from, [this](size_t index_from, size_t index_to) {
+        swap(index_from, index_to);
+    });
+}
+
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+template<typename Swap>
+void priority_queue<Key, Value, Compare, LazyRemoval>::siftDown(size_t index_from, Swap swap_values) {
     while (2 * index_from + 1 < values.size()) {
         size_t index_left = 2 * index_from + 1;
         size_t index_right = 2 * index_from + 2;
@@ -161,25 +249,80 @@ void priority_queue<Key, Value, Compare>::siftDown(size_t index_from) {
         if (!cmp(values[index_to], values[index_from])) {
             break;
         }
-        swap(index_from, index_to);
+        swap_values(index_from, index_to);
         index_from = index_to;
     }
 }
 
-template<typename Key, typename Value, class Compare>
-void priority_queue<Key, Value, Compare>::swap(size_t index_from, size_t index_to) {
-    Key key_from = value_to_key(values[index_from]);
-    Key key_to = value_to_key(values[index_to]);
-    key_indexes[key_from] = index_to;
-    key_indexes[key_to] = index_from;
+/**
+ * Dead elements keep their places in the heap order, but their keys aren't tracked
+ */
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::swap(size_t index_from, size_t index_to) {
+    if (!isDead(index_from)) {
+        key_indexes[value_to_key(values[index_from])] = index_to;
+    }
+    if (!isDead(index_to)) {
+        key_indexes[value_to_key(values[index_to])] = index_from;
+    }
     std::swap(values[index_from], values[index_to]);
+    if constexpr (LazyRemoval) {
+        std::swap(dead_flags[index_from], dead_flags[index_to]);
+    }
 }
 
-template<typename Key, typename Value, class Compare>
-void priority_queue<Key, Value, Compare>::remove(size_t index_from) {
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::remove(size_t index_from) {
     size_t index_back = values.size() - 1;
     swap(index_from, index_back);
-    key_indexes.erase(index_back);
+    if (isDead(index_back)) {
+        --dead_cnt;
+    } else {
+        key_indexes.erase(value_to_key(values[index_back]));
+    }
     values.pop_back();
-    siftDown(index_from);
+    if constexpr (LazyRemoval) {
+        dead_flags.pop_back();
+    }
+    // the last element moved to the removed one's place can be better than its new parent
+    if (index_from < values.size()) {
+        siftUp(index_from);
+        siftDown(index_from);
+    }
+}
+
+/**
+ * Restores the invariant that the top element is live
+ */
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::dropDeadTop() {
+    while (!values.empty() && isDead(0)) {
+        remove(0);
+    }
+}
+
+/**
+ * Moves live elements together and rebuilds the heap bottom-up, then indexes them anew,
+ * so every key is indexed once instead of on every swap
+ * O(n) time complexity
+ */
+template<typename Key, typename Value, class Compare, bool LazyRemoval>
+void priority_queue<Key, Value, Compare, LazyRemoval>::compact() {
+    size_t live_cnt = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (!dead_flags[i]) {
+            values[live_cnt++] = std::move(values[i]);
+        }
+    }
+    values.resize(live_cnt);
+    dead_flags.assign(live_cnt, false);
+    dead_cnt = 0;
+    for (size_t i = live_cnt / 2; i-- > 0;) {
+        siftDown(i, [this](size_t index_from, size_t index_to) {
+            std::swap(values[index_from], values[index_to]);
+        });
+    }
+    for (size_t i = 0; i < live_cnt; ++i) {
+        key_indexes[value_to_key(values[i])] = i;
+    }
 }
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Bounded queue between exactly one producer thread and exactly one consumer thread.
+ * Items are copied in batches, so positions are published once per batch, and each side keeps a cached copy
+ * of the other side's position, so shared cache lines are only touched when the cached view runs out.
+ * The producer waits while the ring is full, which holds back a stage running ahead of the next one
+ */
+template<typename T>
+class spsc_ring {
+
+public:
+
+    /**
+     * @param capacity - maximal number of items in the ring, rounded up to a power of two
+     */
+    explicit spsc_ring(size_t capacity);
+
+    spsc_ring(spsc_ring const &) = delete;
+
+    spsc_ring &operator=(spsc_ring const &) = delete;
+
+    /**
+     * Copies as many items as fit right now, returns their number. Producer only
+     */
+    size_t tryPush(T const *items, size_t cnt);
+
+    /**
+     * Copies all the items, waiting for the consumer while the ring is full. Producer only
+     */
+    void push(T const *items, size_t cnt);
+
+    /**
+     * Tells the consumer that no more items are coming. Producer only
+     */
+    void close();
+
+    /**
+     * Moves out up to `max_cnt` available items, returns their number. Consumer only
+     */
+    size_t tryPop(T *items, size_t max_cnt);
+
+    /**
+     * Moves out up to `max_cnt` items, waiting until at least one is available.
+     * Returns 0 only when the ring is closed and drained. Consumer only
+     */
+    size_t pop(T *items, size_t max_cnt);
+
+private:
+
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    /**
+     * Positions grow forever, the slot is the position modulo capacity
+     */
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head; // next position to pop, written by the consumer
+    size_t cached_tail; // consumer's view of `tail`
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail; // next position to push, written by the producer
+    size_t cached_head; // producer's view of `head`
+
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> is_closed;
+
+    std::vector<T> slots;
+    size_t mask;
+
+    static void wait(size_t &attempts);
+};
+
+template<typename T>
+spsc_ring<T>::spsc_ring(size_t capacity) : head(0), cached_tail(0), tail(0), cached_head(0), is_closed(false) {
+    size_t slots_cnt = 1;
+    while (slots_cnt < capacity) {
+        slots_cnt *= 2;
+    }
+    slots.resize(slots_cnt);
+    mask = slots_cnt - 1;
+}
+
+template<typename T>
+size_t spsc_ring<T>::tryPush(T const *items, size_t cnt) {
+    size_t cur_tail = tail.load(std::memory_order_relaxed);
+    if (cur_tail + cnt - cached_head > slots.size()) {
+        cached_head = head.load(std::memory_order_acquire);
+    }
+    size_t pushed_cnt = std::min(cnt, slots.size() - (cur_tail - cached_head));
+    for (size_t i = 0; i < pushed_cnt; ++i) {
+        slots[(cur_tail + i) & mask] = items[i];
+    }
+    if (pushed_cnt != 0) {
+        tail.store(cur_tail + pushed_cnt, std::memory_order_release);
+    }
+    return pushed_cnt;
+}
+
+template<typename T>
+void spsc_ring<T>::push(T const *items, size_t cnt) {
+    size_t attempts = 0;
+    while (cnt != 0) {
+        size_t pushed_cnt = tryPush(items, cnt);
+        if (pushed_cnt == 0) {
+            wait(attempts);
+            continue;
+        }
+        attempts = 0;
+        items += pushed_cnt;
+        cnt -= pushed_cnt;
+    }
+}
+
+template<typename T>
+void spsc_ring<T>::close() {
+    is_closed.store(true, std::memory_order_release);
+}
+
+template<typename T>
+size_t spsc_ring<T>::tryPop(T *items, size_t max_cnt) {
+    size_t cur_head = head.load(std::memory_order_relaxed);
+    if (cached_tail - cur_head < max_cnt) {
+        cached_tail = tail.load(std::memory_order_acquire);
+    }
+    size_t popped_cnt = std::min(max_cnt, cached_tail - cur_head);
+    for (size_t i = 0; i < popped_cnt; ++i) {
+        items[i] = std::move(slots[(cur_head + i) & mask]);
+    }
+    if (popped_cnt != 0) {
+        head.store(cur_head + popped_cnt, std::memory_order_release);
+    }
+    return popped_cnt;
+}
+
+template<typename T>
+size_t spsc_ring<T>::pop(T *items, size_t max_cnt) {
+    size_t attempts = 0;
+    while (true) {
+        // items pushed before closing are visible once the closing is seen
+        bool is_last_attempt = is_closed.load(std::memory_order_acquire);
+        size_t popped_cnt = tryPop(items, max_cnt);
+        if (popped_cnt != 0 || is_last_attempt) {
+            return popped_cnt;
+        }
+        wait(attempts);
+    }
+}
+
+/**
+ * Spins for a while, then gives the core away, so a stage waiting for a slow neighbour doesn't burn its core
+ */
+template<typename T>
+void spsc_ring<T>::wait(size_t &attempts) {
+    if (++attempts > 64) {
+        std::this_thread::yield();
+    }
+}
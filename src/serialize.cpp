@@ -2,103 +2,208 @@
 #include "serialize.hpp"
 
 #include <vector>
-#include <sstream>
-#include <optional>
+#include <array>
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
 
-std::vector<std::string> splitByChar(const std::string &string, char c);
+/**
+ * Fields of one command, insert has the most of them
+ */
+typedef std::array<std::string_view, 6> Fields;
+
+size_t splitFields(std::string_view line, Fields &fields);
+
+Insert parseInsert(Fields const &fields, size_t fields_cnt, SymbolTable &symbols);
+
+Amend parseAmend(Fields const &fields, size_t fields_cnt);
+
+Pull parsePull(Fields const &fields, size_t fields_cnt);
 
-std::shared_ptr<Insert> parseInsert(const std::vector<std::string> &insert_parts);
+template<typename T>
+T parseInteger(std::string_view integer_str);
 
-std::shared_ptr<Amend> parseAmend(const std::vector<std::string> &amend_parts);
+void appendItem(std::string &out, OrderBook::Item const &item);
 
-std::shared_ptr<Pull> parsePull(const std::vector<std::string> &pull_parts);
+void appendPrice(std::string &out, Price price);
 
-std::string toStringItem(std::optional<OrderBook::Item> bid_opt, std::optional<OrderBook::Item> ask_opt);
+template<typename T>
+void appendInteger(std::string &out, T value);
 
 Price parsePrice(std::string_view price_str);
 
+Commands parseCommands(std::vector<std::string> const &input, SymbolTable &symbols) {
+    auto result = Commands();
+    result.reserve(input.size());
+    for (std::string const &command_serialized : input) {
+        parseCommand(command_serialized, symbols, result);
+    }
+    return result;
+}
+
+void parseCommands(std::string_view input, SymbolTable &symbols, Commands &commands) {
+    while (!input.empty()) {
+        parseCommand(nextLine(input), symbols, commands);
+    }
+}
+
+std::string_view nextLine(std::string_view &input) {
+    size_t line_end = input.find('\n');
+    if (line_end == std::string_view::npos) {
+        line_end = input.size();
+    }
+    std::string_view line = input.substr(0, line_end);
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    input.remove_prefix(std::min(line_end + 1, input.size()));
+    return line;
+}
+
 /**
  * Every command starts with either "INSERT", "AMEND" or "PULL" with additional
  * data in the columns after the command.
  */
-std::vector<std::shared_ptr<Command>> parseCommands(std::vector<std::string> const &input) {
-    auto result = std::vector<std::shared_ptr<Command>>();
-
-    for (std::string const &command_serialized : input) {
-        auto command_parts = splitByChar(command_serialized, ',');
-        if (command_parts.empty()) {
-            throw std::runtime_error("invalid command");
-        }
-        if (command_parts[0] == "INSERT") {
-            result.push_back(parseInsert(command_parts));
-        } else if (command_parts[0] == "AMEND") {
-            result.push_back(parseAmend(command_parts));
-        } else if (command_parts[0] == "PULL") {
-            result.push_back(parsePull(command_parts));
-        } else {
-            throw std::runtime_error("unknown command");
-        }
+void parseCommand(std::string_view line, SymbolTable &symbols, Commands &commands) {
+    Fields fields;
+    size_t fields_cnt = splitFields(line, fields);
+    if (fields_cnt == 0) {
+        throw std::runtime_error("invalid command");
+    }
+    if (fields[0] == "INSERT") {
+        commands.emplace_back(parseInsert(fields, fields_cnt, symbols));
+    } else if (fields[0] == "AMEND") {
+        commands.emplace_back(parseAmend(fields, fields_cnt));
+    } else if (fields[0] == "PULL") {
+        commands.emplace_back(parsePull(fields, fields_cnt));
+    } else {
+        throw std::runtime_error("unknown command");
     }
-    return result;
 }
 
-std::vector<std::string> toString(std::vector<Trade> trades, std::vector<OrderBook> order_books) {
+std::vector<std::string> toString(std::vector<Trade> trades, std::vector<OrderBook> order_books,
+                                  SymbolTable const &symbols) {
+    std::string text;
+    appendTrades(text, trades, symbols);
+    appendOrderBooks(text, std::move(order_books), symbols);
+
     std::vector<std::string> result = std::vector<std::string>();
+    std::string_view rest = text;
+    while (!rest.empty()) {
+        result.emplace_back(nextLine(rest));
+    }
+    return result;
+}
 
+void appendTrades(std::string &out, std::vector<Trade> const &trades, SymbolTable const &symbols) {
     for (Trade const &trade : trades) {
-        std::stringstream stream;
-        stream << trade.symbol << ',' << (double) trade.price / PRICE_SHIFT << ',' << trade.volume << ','
-               << trade.aggressive_order_id << ',' << trade.passive_order_id;
-        result.push_back(stream.str());
+        appendTrade(out, trade, symbols);
     }
+}
+
+void appendTrade(std::string &out, Trade const &trade, SymbolTable const &symbols) {
+    out += symbols.name(trade.symbol);
+    out += ',';
+    appendPrice(out, trade.price);
+    out += ',';
+    appendInteger(out, trade.volume);
+    out += ',';
+    appendInteger(out, trade.aggressive_order_id);
+    out += ',';
+    appendInteger(out, trade.passive_order_id);
+    out += '\n';
+}
+
+TradeFormatter::TradeFormatter(std::string &out, SymbolTable const &symbols) : out(out), symbols(symbols),
+                                                                               trades_cnt(0) {}
+
+void TradeFormatter::onTrade(Trade const &trade) {
+    appendTrade(out, trade, symbols);
+    ++trades_cnt;
+}
+
+size_t TradeFormatter::count() const {
+    return trades_cnt;
+}
+
+void appendLevelUpdate(std::string &out, LevelUpdate const &update, SymbolTable const &symbols) {
+    out += "L,";
+    out += symbols.name(update.symbol);
+    out += update.side == Side::BUY ? ",BUY," : ",SELL,";
+    appendPrice(out, update.price);
+    out += ',';
+    appendInteger(out, update.volume);
+    out += '\n';
+}
+
+FeedFormatter::FeedFormatter(std::string &out, SymbolTable const &symbols) : out(out), symbols(symbols),
+                                                                             trades_cnt(0) {}
+
+void FeedFormatter::onTrade(Trade const &trade) {
+    out += "T,";
+    appendTrade(out, trade, symbols);
+    ++trades_cnt;
+}
 
+void FeedFormatter::onLevelUpdate(LevelUpdate const &update) {
+    appendLevelUpdate(out, update, symbols);
+}
+
+size_t FeedFormatter::count() const {
+    return trades_cnt;
+}
+
+void appendOrderBooks(std::string &out, std::vector<OrderBook> order_books, SymbolTable const &symbols) {
+    std::sort(order_books.begin(), order_books.end(), [&symbols](OrderBook const &lhs, OrderBook const &rhs) {
+        return symbols.name(lhs.symbol) < symbols.name(rhs.symbol);
+    });
     for (OrderBook const &order_book : order_books) {
-        result.push_back("===" + order_book.symbol + "===");
+        out += "===";
+        out += symbols.name(order_book.symbol);
+        out += "===\n";
 
         auto it_items_bids = order_book.bids.begin();
         auto it_items_asks = order_book.asks.begin();
-        while (it_items_bids != order_book.bids.end() && it_items_asks != order_book.asks.end()) {
-            auto bid = *it_items_bids++;
-            auto ask = *it_items_asks++;
-            result.push_back(toStringItem(
-                    std::make_optional<OrderBook::Item>(bid), std::make_optional<OrderBook::Item>(ask)));
-        }
-        while (it_items_bids != order_book.bids.end()) {
-            auto bid = *it_items_bids++;
-            result.push_back(toStringItem(std::make_optional<OrderBook::Item>(bid), std::nullopt));
-        }
-        while (it_items_asks != order_book.asks.end()) {
-            auto ask = *it_items_asks++;
-            result.push_back(toStringItem(std::nullopt, std::make_optional<OrderBook::Item>(ask)));
+        while (it_items_bids != order_book.bids.end() || it_items_asks != order_book.asks.end()) {
+            if (it_items_bids != order_book.bids.end()) {
+                appendItem(out, *it_items_bids++);
+            } else {
+                out += ',';
+            }
+            out += ',';
+            if (it_items_asks != order_book.asks.end()) {
+                appendItem(out, *it_items_asks++);
+            } else {
+                out += ',';
+            }
+            out += '\n';
         }
     }
-
-    return result;
 }
 
-
 /**
  * In case of insert the line will have the format:
  * INSERT,<order_id>,<symbol>,<side>,<price>,<volume>
  * e.g. INSERT,4,AAPL,BUY,23.45,12
  */
-std::shared_ptr<Insert> parseInsert(const std::vector<std::string> &insert_parts) {
-    if (insert_parts.size() != 6) {
+Insert parseInsert(Fields const &fields, size_t fields_cnt, SymbolTable &symbols) {
+    if (fields_cnt != 6) {
         throw std::runtime_error("invalid insert");
     }
-    OrderId order_id = std::stoi(insert_parts[1]);
-    Symbol symbol = insert_parts[2];
+    auto order_id = parseInteger<OrderId>(fields[1]);
+    SymbolId symbol = symbols.intern(fields[2]);
     Side side;
-    if (insert_parts[3] == "SELL") {
+    if (fields[3] == "SELL") {
         side = Side::SELL;
-    } else if (insert_parts[3] == "BUY") {
+    } else if (fields[3] == "BUY") {
         side = Side::BUY;
     } else {
         throw std::runtime_error("invalid insert");
     }
-    Price price = parsePrice(insert_parts[4]);
-    Volume volume = std::stoi(insert_parts[5]);
-    return std::make_shared<Insert>(order_id, symbol, side, price, volume);
+    Price price = parsePrice(fields[4]);
+    auto volume = parseInteger<Volume>(fields[5]);
+    return Insert(order_id, symbol, side, price, volume);
 }
 
 /**
@@ -106,14 +211,14 @@ std::shared_ptr<Insert> parseInsert(const std::vector<std::string> &insert_parts
  * AMEND,<order_id>,<price>,<volume>
  * e.g. AMEND,4,23.12,11
  */
-std::shared_ptr<Amend> parseAmend(const std::vector<std::string> &amend_parts) {
-    if (amend_parts.size() != 4) {
+Amend parseAmend(Fields const &fields, size_t fields_cnt) {
+    if (fields_cnt != 4) {
         throw std::runtime_error("invalid amend");
     }
-    OrderId order_id = std::stoi(amend_parts[1]);
-    Price price = parsePrice(amend_parts[2]);
-    Volume volume = std::stoi(amend_parts[3]);
-    return std::make_shared<Amend>(order_id, price, volume);
+    auto order_id = parseInteger<OrderId>(fields[1]);
+    Price price = parsePrice(fields[2]);
+    auto volume = parseInteger<Volume>(fields[3]);
+    return Amend(order_id, price, volume);
 }
 
 /**
@@ -121,69 +226,127 @@ std::shared_ptr<Amend> parseAmend(const std::vector<std::string> &amend_parts) {
  * <PULL>,<order_id>
  * e.g. PULL,4
  */
-std::shared_ptr<Pull> parsePull(const std::vector<std::string> &pull_parts) {
-    if (pull_parts.size() != 2) {
+Pull parsePull(Fields const &fields, size_t fields_cnt) {
+    if (fields_cnt != 2) {
         throw std::runtime_error("invalid pull");
     }
-    OrderId order_id = std::stoi(pull_parts[1]);
-    return std::make_shared<Pull>(order_id);
+    auto order_id = parseInteger<OrderId>(fields[1]);
+    return Pull(order_id);
 }
 
+/**
+ * Splits the line by commas without copying. Returns number of fields, which is greater than the fields capacity
+ * if there are too many of them
+ */
+size_t splitFields(std::string_view line, Fields &fields) {
+    if (line.empty()) {
+        return 0;
+    }
+    size_t fields_cnt = 0;
+    while (true) {
+        size_t field_end = line.find(',');
+        if (fields_cnt == fields.size()) {
+            return fields_cnt + 1;
+        }
+        fields[fields_cnt++] = line.substr(0, field_end);
+        if (field_end == std::string_view::npos) {
+            return fields_cnt;
+        }
+        line.remove_prefix(field_end + 1);
+    }
+}
 
-std::vector<std::string> splitByChar(const std::string &string, char c) {
-    std::stringstream stream = std::stringstream(string);
-    auto result = std::vector<std::string>();
-    std::string segment;
-    while (std::getline(stream, segment, c)) {
-        result.push_back(segment);
+template<typename T>
+T parseInteger(std::string_view integer_str) {
+    T result;
+    auto const *end = integer_str.data() + integer_str.size();
+    auto parsed = std::from_chars(integer_str.data(), end, result);
+    if (parsed.ec != std::errc() || parsed.ptr != end) {
+        throw std::runtime_error("invalid integer");
     }
     return result;
 }
 
+/**
+ * Price is a decimal number with at most {@see PRICE_SHIFT_PLACES} fractional digits,
+ * it's converted to integer shifted by {@see PRICE_SHIFT}
+ */
 Price parsePrice(std::string_view price_str) {
-    if (price_str.empty()) {
-        return 0;
-    }
-    bool is_fractional_part = false;
+    int64_t result = 0;
+    int32_t digits_cnt = 0;
     int32_t fractional_part_cnt = 0;
+    bool is_fractional_part = false;
 
-    auto it = price_str.begin();
-    int32_t result = (*it++) - '0';
-    while (it != price_str.end()) {
-        if (*it == '.') {
-            ++it;
+    for (char c : price_str) {
+        if (c == '.' && !is_fractional_part) {
             is_fractional_part = true;
             continue;
         }
-        result *= 10;
-        result += (*it++) - '0';
+        if (c < '0' || c > '9' || (is_fractional_part && fractional_part_cnt == PRICE_SHIFT_PLACES)) {
+            throw std::runtime_error("invalid price");
+        }
+        result = result * 10 + (c - '0');
+        if (result > std::numeric_limits<Price>::max()) {
+            throw std::runtime_error("invalid price");
+        }
+        digits_cnt++;
         if (is_fractional_part) {
             fractional_part_cnt++;
         }
     }
+    if (digits_cnt == 0) {
+        throw std::runtime_error("invalid price");
+    }
     while (fractional_part_cnt < PRICE_SHIFT_PLACES) {
         fractional_part_cnt++;
         result *= 10;
+        if (result > std::numeric_limits<Price>::max()) {
+            throw std::runtime_error("invalid price");
+        }
     }
-    return result;
+    return static_cast<Price>(result);
 }
 
-std::string toStringItem(std::optional<OrderBook::Item> bid_opt, std::optional<OrderBook::Item> ask_opt) {
-    std::stringstream stream;
-    if (bid_opt.has_value()) {
-        stream << (double) bid_opt.value().price / PRICE_SHIFT;
-        stream << ',';
-        stream << bid_opt.value().volume;
-        stream << ',';
-    } else {
-        stream << ",,";
+/**
+ * Formats the item as <price>,<volume>
+ */
+void appendItem(std::string &out, OrderBook::Item const &item) {
+    appendPrice(out, item.price);
+    out += ',';
+    appendInteger(out, item.volume);
+}
+
+/**
+ * Price is formatted as a decimal number without trailing zeros in its fractional part, e.g. 23.45 or 21.
+ * Digits are produced from the shifted integer directly, so the decimal value is always exact
+ */
+void appendPrice(std::string &out, Price price) {
+    int64_t value = price;
+    if (value < 0) {
+        out += '-';
+        value = -value;
     }
-    if (ask_opt.has_value()) {
-        stream << (double) ask_opt.value().price / PRICE_SHIFT;
-        stream << ',';
-        stream << ask_opt.value().volume;
-    } else {
-        stream << ",";
+    appendInteger(out, value / PRICE_SHIFT);
+    auto fractional_part = static_cast<int32_t>(value % PRICE_SHIFT);
+    if (fractional_part == 0) {
+        return;
+    }
+    char digits[16];
+    for (int32_t i = PRICE_SHIFT_PLACES - 1; i >= 0; --i) {
+        digits[i] = static_cast<char>('0' + fractional_part % 10);
+        fractional_part /= 10;
+    }
+    int32_t digits_cnt = PRICE_SHIFT_PLACES;
+    while (digits[digits_cnt - 1] == '0') {
+        --digits_cnt;
     }
-    return stream.str();
+    out += '.';
+    out.append(digits, digits_cnt);
+}
+
+template<typename T>
+void appendInteger(std::string &out, T value) {
+    char digits[24];
+    auto formatted = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, formatted.ptr);
 }
@@ -1,12 +1,105 @@
 #pragma once
 
 #include "common.hpp"
+#include "symbols.hpp"
 #include <vector>
-#include <memory>
+#include <string_view>
 
 static int32_t PRICE_SHIFT = 10000;
 static int32_t PRICE_SHIFT_PLACES = 4;
 
-std::vector<std::shared_ptr<Command>> parseCommands(std::vector<std::string> const &input);
+/**
+ * Parses commands, symbols are interned into `symbols`
+ */
+Commands parseCommands(std::vector<std::string> const &input, SymbolTable &symbols);
 
-std::vector<std::string> toString(std::vector<Trade> trades, std::vector<OrderBook> order_books);
\ No newline at end of file
+/**
+ * Parses newline-separated commands and appends them to `commands`, lines are read in place without copying
+ */
+void parseCommands(std::string_view input, SymbolTable &symbols, Commands &commands);
+
+/**
+ * Cuts the first line from `input`, the line is returned without its "\n" or "\r\n" ending
+ */
+std::string_view nextLine(std::string_view &input);
+
+/**
+ * Parses one command line and appends the command to `commands`
+ */
+void parseCommand(std::string_view line, SymbolTable &symbols, Commands &commands);
+
+/**
+ * Formats trades in chronological order and order books in alphabetical order of their symbols
+ */
+std::vector<std::string> toString(std::vector<Trade> trades, std::vector<OrderBook> order_books,
+                                  SymbolTable const &symbols);
+
+/**
+ * Appends trades to `out`, one per line:
+ * <symbol>,<price>,<volume>,<aggressive_order_id>,<passive_order_id>
+ */
+void appendTrades(std::string &out, std::vector<Trade> const &trades, SymbolTable const &symbols);
+
+/**
+ * Appends one trade line to `out` {@see appendTrades}
+ */
+void appendTrade(std::string &out, Trade const &trade, SymbolTable const &symbols);
+
+/**
+ * Trade listener which formats trades to a buffer as soon as they happen
+ */
+class TradeFormatter : public TradeListener {
+public:
+
+    TradeFormatter(std::string &out, SymbolTable const &symbols);
+
+    void onTrade(Trade const &trade) override;
+
+    /**
+     * Number of formatted trades
+     */
+    size_t count() const;
+
+private:
+
+    std::string &out;
+    SymbolTable const &symbols;
+    size_t trades_cnt;
+};
+
+/**
+ * Appends one level update line to `out`:
+ * L,<symbol>,<BUY|SELL>,<price>,<volume>
+ */
+void appendLevelUpdate(std::string &out, LevelUpdate const &update, SymbolTable const &symbols);
+
+/**
+ * Formats the market data feed to a buffer as soon as it happens: level updates {@see appendLevelUpdate}
+ * and trades as "T," followed by the trade line {@see appendTrade}, in the order the engine reports them
+ */
+class FeedFormatter : public TradeListener, public BookListener {
+public:
+
+    FeedFormatter(std::string &out, SymbolTable const &symbols);
+
+    void onTrade(Trade const &trade) override;
+
+    void onLevelUpdate(LevelUpdate const &update) override;
+
+    /**
+     * Number of formatted trades
+     */
+    size_t count() const;
+
+private:
+
+    std::string &out;
+    SymbolTable const &symbols;
+    size_t trades_cnt;
+};
+
+/**
+ * Appends order books in alphabetical order of their symbols to `out`, one line per row:
+ * separator "===<symbol>===" and then <bid_price>,<bid_volume>,<ask_price>,<ask_volume> rows
+ */
+void appendOrderBooks(std::string &out, std::vector<OrderBook> order_books, SymbolTable const &symbols);
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "sharded.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+/* ShardedEngine definition */
+
+ShardedEngine::ShardedEngine(size_t shards_cnt, TradeListener *trade_listener) : trade_listener(trade_listener),
+                                                                                  busy_cnt(0) {
+    if (shards_cnt == 0) {
+        throw std::runtime_error("number of shards must be positive");
+    }
+    shards.reserve(shards_cnt);
+    for (size_t i = 0; i < shards_cnt; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    for (auto &shard : shards) {
+        shard->worker = std::thread(&ShardedEngine::work, this, std::ref(*shard));
+    }
+}
+
+ShardedEngine::~ShardedEngine() {
+    for (auto &shard : shards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->is_stopped = true;
+        }
+        shard->has_work_cv.notify_one();
+    }
+    for (auto &shard : shards) {
+        shard->worker.join();
+    }
+}
+
+void ShardedEngine::apply(Commands const &commands) {
+    // route commands, the front end has to know shards of orders before workers see their amends and pulls
+    for (size_t sequence = 0; sequence < commands.size(); ++sequence) {
+        Command const &command = commands[sequence];
+        uint32_t shard_index;
+        if (auto insert = std::get_if<Insert>(&command)) {
+            shard_index = insert->symbol % shards.size();
+            if (!seen_ids.insert(insert->order_id)) {
+                continue; // already inserted
+            }
+            order_shards.insert(insert->order_id, shard_index);
+        } else {
+            OrderId order_id = std::holds_alternative<Amend>(command) ? std::get<Amend>(command).order_id
+                                                                      : std::get<Pull>(command).order_id;
+            uint32_t const *shard_ptr = order_shards.find(order_id);
+            if (shard_ptr == nullptr) {
+                continue; // unknown, filled or pulled order
+            }
+            shard_index = *shard_ptr;
+        }
+        Shard &shard = *shards[shard_index];
+        shard.commands.push_back(command);
+        shard.sequences.push_back(sequence);
+    }
+
+    // run all shards with commands and wait for them
+    std::unique_lock<std::mutex> done_lock(done_mutex);
+    for (auto &shard : shards) {
+        if (shard->commands.empty()) {
+            continue;
+        }
+        ++busy_cnt;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->has_work = true;
+        }
+        shard->has_work_cv.notify_one();
+    }
+    done_cv.wait(done_lock, [this] { return busy_cnt == 0; });
+    done_lock.unlock();
+
+    mergeTrades();
+    dropFinishedOrders();
+}
+
+std::vector<OrderBook> ShardedEngine::getOrderBooks() {
+    std::vector<OrderBook> order_books;
+    for (auto &shard : shards) {
+        std::vector<OrderBook> shard_books = shard->engine.getOrderBooks();
+        std::move(shard_books.begin(), shard_books.end(), std::back_inserter(order_books));
+    }
+    std::sort(order_books.begin(), order_books.end(), [](OrderBook const &lhs, OrderBook const &rhs) {
+        return lhs.symbol < rhs.symbol;
+    });
+    return order_books;
+}
+
+BestBidOffer ShardedEngine::getBestBidOffer(SymbolId symbol) const {
+    return shards[symbol % shards.size()]->engine.getBestBidOffer(symbol);
+}
+
+void ShardedEngine::getTopLevels(SymbolId symbol, Side side, size_t depth,
+                                 std::vector<OrderBook::Item> &levels) const {
+    shards[symbol % shards.size()]->engine.getTopLevels(symbol, side, depth, levels);
+}
+
+int64_t ShardedEngine::getVolumeTo(SymbolId symbol, Side side, Price price) const {
+    return shards[symbol % shards.size()]->engine.getVolumeTo(symbol, side, price);
+}
+
+LatencyHistogram ShardedEngine::latencyHistogram(LatencyKind kind) const {
+    LatencyHistogram histogram;
+    for (auto const &shard : shards) {
+        histogram.merge(shard->engine.latencyHistogram(kind));
+    }
+    return histogram;
+}
+
+/* ShardedEngine implementation details */
+
+void ShardedEngine::Shard::onTrade(Trade const &trade) {
+    trades.push_back(SequencedTrade{current_sequence, trade});
+}
+
+void ShardedEngine::work(Shard &shard) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.has_work_cv.wait(lock, [&shard] { return shard.has_work || shard.is_stopped; });
+            if (shard.is_stopped) {
+                return;
+            }
+            shard.has_work = false;
+        }
+
+        for (size_t i = 0; i < shard.commands.size(); ++i) {
+            shard.current_sequence = shard.sequences[i];
+            shard.engine.apply(shard.commands[i]);
+        }
+        // only orders of the batch's commands and passive orders of its trades could be finished by it
+        for (Command const &command : shard.commands) {
+            OrderId order_id = std::visit([](auto const &command) { return command.order_id; }, command);
+            if (!shard.engine.hasOrder(order_id)) {
+                shard.finished_ids.push_back(order_id);
+            }
+        }
+        for (SequencedTrade const &sequenced_trade : shard.trades) {
+            if (!shard.engine.hasOrder(sequenced_trade.trade.passive_order_id)) {
+                shard.finished_ids.push_back(sequenced_trade.trade.passive_order_id);
+            }
+        }
+        shard.commands.clear();
+        shard.sequences.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            --busy_cnt;
+        }
+        done_cv.notify_one();
+    }
+}
+
+/**
+ * Every command is matched by one shard and every shard reports its trades in command order,
+ * so merging shards' trades by command position reproduces the order of one engine
+ */
+void ShardedEngine::mergeTrades() {
+    std::vector<size_t> positions(shards.size(), 0);
+    while (true) {
+        Shard *next_shard = nullptr;
+        size_t *next_position = nullptr;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            Shard &shard = *shards[i];
+            if (positions[i] == shard.trades.size()) {
+                continue;
+            }
+            if (next_shard == nullptr ||
+                shard.trades[positions[i]].sequence < next_shard->trades[*next_position].sequence) {
+                next_shard = &shard;
+                next_position = &positions[i];
+            }
+        }
+        if (next_shard == nullptr) {
+            break;
+        }
+        if (trade_listener != nullptr) {
+            trade_listener->onTrade(next_shard->trades[*next_position].trade);
+        }
+        ++*next_position;
+    }
+    for (auto &shard : shards) {
+        shard->trades.clear();
+    }
+}
+
+void ShardedEngine::dropFinishedOrders() {
+    for (auto &shard : shards) {
+        for (OrderId order_id : shard->finished_ids) {
+            order_shards.erase(order_id);
+        }
+        shard->finished_ids.clear();
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "common.hpp"
+#include "engine.hpp"
+#include "flat_hash_map.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Matching engine which splits symbols between several worker threads.
+ * Books of distinct symbols never interact, so every worker owns a private {@see CLOBEngine} for its symbols.
+ * Inserts are routed by symbol, amends and pulls by the shard their order was inserted to.
+ * Trades are reported in exactly the same order as one {@see CLOBEngine} would report them.
+ */
+class ShardedEngine {
+public:
+
+    /**
+     * @param shards_cnt - number of worker threads
+     * @param trade_listener - receives trades after every batch, called from the thread which applies commands
+     */
+    ShardedEngine(size_t shards_cnt, TradeListener *trade_listener = nullptr);
+
+    ShardedEngine(ShardedEngine const &) = delete;
+
+    ShardedEngine &operator=(ShardedEngine const &) = delete;
+
+    /**
+     * Stops the workers
+     */
+    ~ShardedEngine();
+
+    /**
+     * Matches the batch on the workers and waits for them, then reports trades of the batch in order
+     */
+    void apply(Commands const &commands);
+
+    /**
+     * Returns current non-empty order books ordered by symbol identifier
+     */
+    std::vector<OrderBook> getOrderBooks();
+
+    /**
+     * Depth queries of the symbol's shard {@see CLOBEngine::getBestBidOffer}.
+     * Must not be called while a batch is being applied
+     */
+    BestBidOffer getBestBidOffer(SymbolId symbol) const;
+
+    void getTopLevels(SymbolId symbol, Side side, size_t depth, std::vector<OrderBook::Item> &levels) const;
+
+    int64_t getVolumeTo(SymbolId symbol, Side side, Price price) const;
+
+    /**
+     * Latencies of the kind recorded by all shards {@see CLOBEngine::latencyHistogram}
+     */
+    LatencyHistogram latencyHistogram(LatencyKind kind) const;
+
+private:
+
+    /**
+     * Trade made by the command with such position in the batch
+     */
+    struct SequencedTrade {
+        size_t sequence;
+        Trade trade;
+    };
+
+    struct Shard : public TradeListener {
+        CLOBEngine engine;
+        std::thread worker;
+
+        /**
+         * Commands of the current batch with their positions in the batch
+         */
+        Commands commands;
+        std::vector<size_t> sequences;
+        size_t current_sequence = 0;
+        std::vector<SequencedTrade> trades;
+
+        /**
+         * Orders of the current batch which were filled or pulled
+         */
+        std::vector<OrderId> finished_ids;
+
+        std::mutex mutex;
+        std::condition_variable has_work_cv;
+        bool has_work = false;
+        bool is_stopped = false;
+
+        Shard() : engine(this) {}
+
+        void onTrade(Trade const &trade) override;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    TradeListener *trade_listener;
+
+    /**
+     * Shard of every resting order, entries of finished orders are erased after every batch
+     */
+    flat_hash_map<OrderId, uint32_t> order_shards;
+
+    /**
+     * Identifiers of all inserted orders, used to drop duplicate inserts before they are routed
+     */
+    OrderIdSet seen_ids;
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    size_t busy_cnt;
+
+    void work(Shard &shard);
+
+    void mergeTrades();
+
+    /**
+     * Forgets shards of orders finished by the batch
+     */
+    void dropFinishedOrders();
+};
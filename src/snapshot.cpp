@@ -0,0 +1,38 @@
+#include "snapshot.hpp"
+#include "binary.hpp"
+
+#include <stdexcept>
+
+void writeSnapshot(CLOBEngine const &engine, SymbolTable const &symbols, std::string &out, uint64_t commands_cnt) {
+    out.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    appendLittleEndian<uint32_t>(out, SNAPSHOT_VERSION);
+    appendLittleEndian<uint64_t>(out, commands_cnt);
+    appendLittleEndian<uint32_t>(out, static_cast<uint32_t>(symbols.size()));
+    for (SymbolId symbol = 0; symbol < symbols.size(); ++symbol) {
+        Symbol const &name = symbols.name(symbol);
+        appendLittleEndian<uint32_t>(out, static_cast<uint32_t>(name.size()));
+        out.append(name);
+    }
+    engine.writeSnapshot(out);
+}
+
+uint64_t restoreSnapshot(std::string_view data, CLOBEngine &engine, SymbolTable &symbols) {
+    ByteReader reader(data, "snapshot");
+    if (reader.readBytes(sizeof(SNAPSHOT_MAGIC)) != std::string_view(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) ||
+        reader.read<uint32_t>() != SNAPSHOT_VERSION) {
+        throw std::runtime_error("invalid snapshot header");
+    }
+    auto commands_cnt = reader.read<uint64_t>();
+    if (symbols.size() != 0) {
+        throw std::runtime_error("snapshot can only be restored with a new symbol table");
+    }
+    auto symbols_cnt = reader.read<uint32_t>();
+    for (uint32_t i = 0; i < symbols_cnt; ++i) {
+        auto name_size = reader.read<uint32_t>();
+        if (symbols.intern(reader.readBytes(name_size)) != i) {
+            throw std::runtime_error("duplicate symbol in snapshot");
+        }
+    }
+    engine.restoreSnapshot(reader.rest());
+    return commands_cnt;
+}
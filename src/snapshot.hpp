@@ -0,0 +1,31 @@
+#pragma once
+
+#include "engine.hpp"
+#include "symbols.hpp"
+
+#include <string>
+#include <string_view>
+
+/**
+ * Engine snapshot format, all integers are little-endian:
+ * - header: magic "WBTS", u32 format version, u64 number of commands applied before the snapshot,
+ *   u32 number of symbols
+ * - symbols in order of their identifiers: u32 name length, name bytes
+ * - state of the engine {@see CLOBEngine::writeSnapshot}
+ */
+
+static char const SNAPSHOT_MAGIC[4] = {'W', 'B', 'T', 'S'};
+static uint32_t const SNAPSHOT_VERSION = 2;
+
+/**
+ * Appends the snapshot of the engine and the symbols it refers to to `out`.
+ * `commands_cnt` is the number of commands the engine has applied, so a journal can be replayed from the next one
+ */
+void writeSnapshot(CLOBEngine const &engine, SymbolTable const &symbols, std::string &out, uint64_t commands_cnt = 0);
+
+/**
+ * Restores the engine and the symbols from the snapshot, e.g. from a mapped file, returns the number of commands
+ * applied before the snapshot. Both the engine and the symbol table must be new.
+ * Throws std::runtime_error if the snapshot is invalid
+ */
+uint64_t restoreSnapshot(std::string_view data, CLOBEngine &engine, SymbolTable &symbols);
@@ -0,0 +1,37 @@
+#include "stream.hpp"
+#include "engine.hpp"
+#include "serialize.hpp"
+
+#include <string>
+
+void runStream(std::istream &input, std::ostream &output) {
+    SymbolTable symbols = SymbolTable();
+    std::string text;
+    TradeFormatter trade_formatter(text, symbols);
+    CLOBEngine engine = CLOBEngine(&trade_formatter);
+    Commands commands;
+    commands.reserve(STREAM_BATCH_SIZE);
+
+    auto flush = [&]() {
+        engine.applyBatch(commands);
+        commands.clear();
+        output << text;
+        text.clear();
+    };
+
+    std::string line;
+    while (std::getline(input, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        parseCommand(line, symbols, commands);
+        if (commands.size() == STREAM_BATCH_SIZE) {
+            flush();
+        }
+    }
+    flush();
+
+    text.clear();
+    appendOrderBooks(text, engine.getOrderBooks(), symbols);
+    output << text;
+}
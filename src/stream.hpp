@@ -0,0 +1,16 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+
+/**
+ * Number of commands parsed before they are applied and their trades are written
+ */
+static size_t const STREAM_BATCH_SIZE = 4096;
+
+/**
+ * Reads commands from `input` line by line and writes the same lines as {@see run()} to `output`, one per line.
+ * Trades are written as soon as their batch of commands is applied, so memory use depends on the size of
+ * the order books and not on the length of the input
+ */
+void runStream(std::istream &input, std::ostream &output);
@@ -0,0 +1,20 @@
+#include "symbols.hpp"
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    auto symbol = static_cast<SymbolId>(names.size());
+    names.emplace_back(name);
+    ids.emplace(names.back(), symbol);
+    return symbol;
+}
+
+Symbol const &SymbolTable::name(SymbolId symbol) const {
+    return names[symbol];
+}
+
+size_t SymbolTable::size() const {
+    return names.size();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * Maps symbol names to dense identifiers starting from 0, so books and orders can refer to symbols
+ * by index and names are only needed to parse input and format output
+ */
+class SymbolTable {
+public:
+
+    /**
+     * Returns identifier of the symbol, registers the symbol if it's seen for the first time
+     * O(1) time complexity
+     */
+    SymbolId intern(std::string_view name);
+
+    /**
+     * Returns name of the registered symbol
+     * O(1) time complexity
+     */
+    Symbol const &name(SymbolId symbol) const;
+
+    /**
+     * Number of registered symbols, every identifier is lower than this value
+     */
+    size_t size() const;
+
+private:
+
+    /**
+     * Deque never moves its elements, so keys of `ids` stay valid
+     */
+    std::deque<Symbol> names;
+
+    std::unordered_map<std::string_view, SymbolId> ids;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "common.hpp"
+#include "level.hpp"
+
+#include <map>
+#include <utility>
+
+/**
+ * One side of an order book organized as a balanced search tree of price levels, the best level first.
+ * Every level keeps its orders in FIFO like {@see price_ladder} does, but new levels never shift other levels,
+ * at the cost of a node allocation per level and pointer chasing on every lookup.
+ * Models the book side storage concept {@see BasicCLOBEngine}
+ */
+template<Side side>
+class price_tree {
+
+public:
+
+    /**
+     * Appends the order to the end of its price level, creating the level if needed.
+     * Returns the new total volume of the level
+     * O(log(levels)) time complexity
+     */
+    Volume push(OrderPool &orders, OrderHandle handle);
+
+    /**
+     * Returns the oldest order on the best level
+     * O(1) time complexity
+     */
+    OrderHandle top() const;
+
+    /**
+     * Returns price and total volume of the best level
+     * O(1) time complexity
+     */
+    std::pair<Price, Volume> bestLevel() const;
+
+    /**
+     * Decreases the volume of the oldest order on the best level, the order is unlinked from the tree
+     * if nothing is left of it, the caller owns its slot then.
+     * Returns the new total volume of the level, 0 if the level is dropped
+     * O(1) amortized time complexity
+     */
+    Volume fillTop(OrderPool &orders, Volume volume);
+
+    /**
+     * Changes the volume of the order in place, so it keeps its time priority.
+     * Returns the new total volume of the order's level
+     * O(log(levels)) time complexity
+     */
+    Volume setVolume(OrderPool &orders, OrderHandle handle, Volume volume);
+
+    /**
+     * Unlinks the order from the tree, the caller owns its slot then.
+     * Returns the new total volume of the order's level, 0 if the level is dropped
+     * O(log(levels)) time complexity
+     */
+    Volume remove(OrderPool &orders, OrderHandle handle);
+
+    /**
+     * `true` if there are no orders on this side, `false` otherwise
+     * O(1) time complexity
+     */
+    bool empty() const;
+
+    /**
+     * Calls `f(price, volume)` for levels from the best one while it returns `true`
+     * O(visited levels) time complexity
+     */
+    template<typename F>
+    void forEachLevel(F f) const;
+
+    /**
+     * Calls `f(order)` for orders in their priority: levels from the best one, orders of a level in FIFO order
+     * O(orders) time complexity
+     */
+    template<typename F>
+    void forEachOrder(OrderPool const &orders, F f) const;
+
+private:
+
+    struct PriceComparator {
+        bool operator()(Price lhs, Price rhs) const {
+            return isBetterPrice<side>(lhs, rhs);
+        }
+    };
+
+    std::map<Price, PriceLevel, PriceComparator> price_levels;
+
+    Volume unlink(OrderPool &orders, typename std::map<Price, PriceLevel, PriceComparator>::iterator it_level,
+                  Order const &order);
+};
+
+template<Side side>
+Volume price_tree<side>::push(OrderPool &orders, OrderHandle handle) {
+    PriceLevel &level = price_levels[orders[handle].price];
+    level.append(orders, handle);
+    return level.volume;
+}
+
+template<Side side>
+OrderHandle price_tree<side>::top() const {
+    return price_levels.begin()->second.head;
+}
+
+template<Side side>
+std::pair<Price, Volume> price_tree<side>::bestLevel() const {
+    return {price_levels.begin()->first, price_levels.begin()->second.volume};
+}
+
+template<Side side>
+Volume price_tree<side>::fillTop(OrderPool &orders, Volume volume) {
+    PriceLevel &level = price_levels.begin()->second;
+    Order &order = orders[level.head];
+    order.volume -= volume;
+    level.volume -= volume;
+    if (order.volume != 0) {
+        return level.volume;
+    }
+    return unlink(orders, price_levels.begin(), order);
+}
+
+template<Side side>
+Volume price_tree<side>::setVolume(OrderPool &orders, OrderHandle handle, Volume volume) {
+    Order &order = orders[handle];
+    PriceLevel &level = price_levels.find(order.price)->second;
+    level.volume += volume - order.volume;
+    order.volume = volume;
+    return level.volume;
+}
+
+template<Side side>
+Volume price_tree<side>::remove(OrderPool &orders, OrderHandle handle) {
+    Order const &order = orders[handle];
+    return unlink(orders, price_levels.find(order.price), order);
+}
+
+template<Side side>
+bool price_tree<side>::empty() const {
+    return price_levels.empty();
+}
+
+template<Side side>
+template<typename F>
+void price_tree<side>::forEachLevel(F f) const {
+    for (auto const &[price, level] : price_levels) {
+        if (!f(price, level.volume)) {
+            return;
+        }
+    }
+}
+
+template<Side side>
+template<typename F>
+void price_tree<side>::forEachOrder(OrderPool const &orders, F f) const {
+    for (auto const &[price, level] : price_levels) {
+        for (OrderHandle handle = level.head; handle != NULL_POOL_HANDLE; handle = orders[handle].next) {
+            f(orders[handle]);
+        }
+    }
+}
+
+/**
+ * Removes the order from its level's FIFO and drops the level if it becomes empty.
+ * Returns the new total volume of the level, 0 if it's dropped
+ */
+template<Side side>
+Volume price_tree<side>::unlink(OrderPool &orders,
+                                typename std::map<Price, PriceLevel, PriceComparator>::iterator it_level,
+                                Order const &order) {
+    it_level->second.unlink(orders, order);
+    if (it_level->second.empty()) {
+        price_levels.erase(it_level);
+        return 0;
+    }
+    return it_level->second.volume;
+}
@@ -0,0 +1,64 @@
+#include "writer.hpp"
+
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+BufferedWriter::BufferedWriter(int fd, size_t capacity) : fd(fd), is_owned(false), capacity(capacity),
+                                                          written_cnt(0) {
+    buffer.reserve(capacity);
+}
+
+BufferedWriter::BufferedWriter(std::string const &path, size_t capacity) : is_owned(true), capacity(capacity),
+                                                                           written_cnt(0) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("can't open " + path);
+    }
+    buffer.reserve(capacity);
+}
+
+BufferedWriter::~BufferedWriter() {
+    try {
+        flush();
+    } catch (std::runtime_error const &) {
+        // destructor can't report the failure, callers which care flush explicitly
+    }
+    if (is_owned) {
+        close(fd);
+    }
+}
+
+void BufferedWriter::write(std::string_view data) {
+    if (buffer.size() + data.size() > capacity) {
+        flush();
+    }
+    buffer.append(data);
+    written_cnt += data.size();
+}
+
+void BufferedWriter::writeLine(std::string_view line) {
+    write(line);
+    write("\n");
+}
+
+void BufferedWriter::flush() {
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        ssize_t written_now = ::write(fd, buffer.data() + offset, buffer.size() - offset);
+        if (written_now < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            buffer.clear();
+            throw std::runtime_error("can't write output");
+        }
+        offset += static_cast<size_t>(written_now);
+    }
+    buffer.clear();
+}
+
+size_t BufferedWriter::written() const {
+    return written_cnt;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/**
+ * Writes output to a file descriptor through one large buffer, so the system is called once per buffer
+ * instead of once per line
+ */
+class BufferedWriter {
+public:
+
+    static size_t const DEFAULT_CAPACITY = 1 << 16;
+
+    /**
+     * Writer to an already opened descriptor, e.g. STDOUT_FILENO. The descriptor isn't closed by the writer
+     */
+    explicit BufferedWriter(int fd, size_t capacity = DEFAULT_CAPACITY);
+
+    /**
+     * Writer to a file, which is created or truncated. Throws std::runtime_error if the file can't be opened
+     */
+    explicit BufferedWriter(std::string const &path, size_t capacity = DEFAULT_CAPACITY);
+
+    BufferedWriter(BufferedWriter const &) = delete;
+
+    BufferedWriter &operator=(BufferedWriter const &) = delete;
+
+    /**
+     * Flushes the buffer and closes the file if it was opened by the writer
+     */
+    ~BufferedWriter();
+
+    void write(std::string_view data);
+
+    /**
+     * Writes the data followed by a newline
+     */
+    void writeLine(std::string_view line);
+
+    /**
+     * Passes buffered data to the system, throws std::runtime_error on failure
+     */
+    void flush();
+
+    /**
+     * Number of bytes written so far
+     */
+    size_t written() const;
+
+private:
+
+    int fd;
+    bool is_owned;
+    std::string buffer;
+    size_t capacity;
+    size_t written_cnt;
+};
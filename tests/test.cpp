@@ -4,16 +4,35 @@
 
 #include "../src/engine.hpp"
 #include "../src/serialize.hpp"
+#include "../src/stream.hpp"
+#include "../src/binary.hpp"
+#include "../src/sharded.hpp"
+#include "../src/pipeline.hpp"
+#include "../src/ring.hpp"
+#include "../src/parallel_parser.hpp"
+#include "../src/snapshot.hpp"
+#include "../src/journal.hpp"
+#include "../src/queue.hpp"
+#include "../src/flat_hash_map.hpp"
+#include "../src/pool.hpp"
+#include "../src/writer.hpp"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+#include <cstdio>
+#include <unistd.h>
 
 std::vector<std::string> run(std::vector<std::string> const &input) {
-    CLOBEngine engine = CLOBEngine();
+    SymbolTable symbols = SymbolTable();
+    TradeCollector trade_collector;
+    CLOBEngine engine = CLOBEngine(&trade_collector);
 
-    std::vector<std::shared_ptr<Command>> commands = parseCommands(input);
-    for (auto const &command : commands) {
-        command->accept(&engine);
-    }
+    engine.apply(parseCommands(input, symbols));
 
-    std::vector<std::string> result = toString(engine.getTrades(), engine.getOrderBooks());
+    std::vector<std::string> result = toString(trade_collector.getTrades(), engine.getOrderBooks(), symbols);
     for (const auto &row : result) {
 //        std::cerr << row << "\n";
     }
@@ -402,6 +421,907 @@ void test_insert_6() {
     assert(result[6] == "1,1,6,1");
 }
 
+void test_pull_inner_level() {
+    std::cout << "pull inner level" << std::endl;
+
+    std::vector<std::string> input = std::vector<std::string>();
+    input.emplace_back("INSERT,1,A,SELL,5,1");
+    input.emplace_back("INSERT,2,A,SELL,4,2");
+    input.emplace_back("INSERT,3,A,SELL,4,3");
+    input.emplace_back("INSERT,4,A,SELL,3,4");
+    input.emplace_back("PULL,2");
+    input.emplace_back("PULL,4");
+    input.emplace_back("INSERT,5,A,BUY,5,5");
+
+    std::vector<std::string> result = run(input);
+    assert(result.size() == 4);
+    assert(result[0] == "A,4,3,5,3");
+    assert(result[1] == "A,5,1,5,1");
+    assert(result[2] == "===A===");
+    assert(result[3] == "5,1,,");
+}
+
+void test_parse_text() {
+    std::cout << "parse text" << std::endl;
+
+    SymbolTable symbols = SymbolTable();
+    Commands commands;
+    parseCommands("INSERT,1,AAPL,BUY,12.2,5\r\nAMEND,1,12.0001,4\nPULL,1\n", symbols, commands);
+    assert(commands.size() == 3);
+    auto insert = std::get_if<Insert>(&commands[0]);
+    assert(insert && insert->price == 122000 && insert->volume == 5 && symbols.name(insert->symbol) == "AAPL");
+    auto amend = std::get_if<Amend>(&commands[1]);
+    assert(amend && amend->price == 120001 && amend->volume == 4);
+    auto pull = std::get_if<Pull>(&commands[2]);
+    assert(pull && pull->order_id == 1);
+
+    for (std::string_view line : {"AMEND,1,12.00001,4", "AMEND,1,1.2.3,4", "AMEND,1,,4", "AMEND,1,1,4x", "PULL,1,"}) {
+        bool is_thrown = false;
+        try {
+            parseCommand(line, symbols, commands);
+        } catch (std::runtime_error const &) {
+            is_thrown = true;
+        }
+        assert(is_thrown);
+    }
+}
+
+void test_stream() {
+    std::cout << "stream" << std::endl;
+
+    std::vector<std::string> input = std::vector<std::string>();
+    int count = 10000;
+    for (int buy_id = 1; buy_id <= count; ++buy_id) {
+        input.emplace_back("INSERT," + std::to_string(buy_id) + ",WEBB,BUY,45.9" + std::to_string(buy_id % 10) + ",10");
+    }
+    input.emplace_back("INSERT," + std::to_string(count + 1) + ",WEBB,SELL,45.95,30001");
+    input.emplace_back("AMEND,17,45.99,5");
+    input.emplace_back("INSERT," + std::to_string(count + 2) + ",AAPL,SELL,1,1");
+
+    std::stringstream input_stream;
+    std::string expected;
+    for (std::string const &line : input) {
+        input_stream << line << "\r\n";
+    }
+    for (std::string const &row : run(input)) {
+        expected += row + "\n";
+    }
+
+    std::stringstream output_stream;
+    runStream(input_stream, output_stream);
+    assert(output_stream.str() == expected);
+}
+
+void test_binary_commands() {
+    std::cout << "binary commands" << std::endl;
+
+    SymbolTable symbols = SymbolTable();
+    Commands commands;
+    parseCommands("INSERT,1,AAPL,BUY,12.2,5\nINSERT,2,WEBB,SELL,0.0001,7\nAMEND,1,12.3,4\nPULL,2\n", symbols, commands);
+    std::string encoded;
+    encodeCommands(commands, symbols, encoded);
+    assert(isBinaryCommands(encoded));
+
+    // symbols are interned into a table which already has other symbols
+    SymbolTable decoded_symbols = SymbolTable();
+    decoded_symbols.intern("TSLA");
+    BinaryCommandReader reader(encoded, decoded_symbols);
+    Commands decoded;
+    assert(reader.read(decoded, 3) == 3);
+    assert(reader.read(decoded, 3) == 1);
+    assert(reader.empty());
+
+    auto insert = std::get_if<Insert>(&decoded[1]);
+    assert(insert && insert->order_id == 2 && insert->side == Side::SELL && insert->price == 1 && insert->volume == 7);
+    assert(decoded_symbols.name(insert->symbol) == "WEBB");
+    auto amend = std::get_if<Amend>(&decoded[2]);
+    assert(amend && amend->order_id == 1 && amend->price == 123000 && amend->volume == 4);
+    auto pull = std::get_if<Pull>(&decoded[3]);
+    assert(pull && pull->order_id == 2);
+}
+
+void test_format_prices() {
+    std::cout << "format prices" << std::endl;
+
+    SymbolTable symbols = SymbolTable();
+    SymbolId symbol = symbols.intern("A");
+    std::string text;
+    appendTrades(text, {Trade(symbol, 12345678, 3, 1, 2), Trade(symbol, 1, 4, 3, 4)}, symbols);
+    appendOrderBooks(text, {OrderBook(symbol, {OrderBook::Item(200000, 1)}, {})}, symbols);
+    assert(text == "A,1234.5678,3,1,2\nA,0.0001,4,3,4\n===A===\n20,1,,\n");
+}
+
+/**
+ * Deterministic random mix of inserts, amends and pulls on several symbols
+ */
+std::vector<std::string> randomCommands(int count) {
+    std::vector<std::string> symbol_names = {"AAPL", "WEBB", "TSLA", "MSFT", "NVDA"};
+    std::vector<std::string> input = std::vector<std::string>();
+    uint64_t seed = 42;
+    auto random = [&seed](uint64_t bound) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (seed >> 33) % bound;
+    };
+    for (int id = 1; id <= count; ++id) {
+        std::string order_id = std::to_string(random(id) + 1);
+        std::string price = std::to_string(100 + random(20)) + "." + std::to_string(random(10));
+        std::string volume = std::to_string(random(50) + 1);
+        switch (random(4)) {
+            case 0:
+                input.emplace_back("AMEND," + order_id + "," + price + "," + volume);
+                break;
+            case 1:
+                input.emplace_back("PULL," + order_id);
+                break;
+            default:
+                input.emplace_back("INSERT," + std::to_string(id) + "," + symbol_names[random(symbol_names.size())] +
+                                   (random(2) ? ",BUY," : ",SELL,") + price + "," + volume);
+        }
+    }
+    return input;
+}
+
+void test_sharded() {
+    std::cout << "sharded" << std::endl;
+
+    std::vector<std::string> input = randomCommands(20000);
+    SymbolTable symbols = SymbolTable();
+    Commands commands = parseCommands(input, symbols);
+    TradeCollector trade_collector;
+    ShardedEngine engine(3, &trade_collector);
+    // split into several batches, so orders are amended and pulled in later batches
+    for (size_t begin = 0; begin < commands.size(); begin += 1000) {
+        engine.apply(Commands(commands.begin() + begin, commands.begin() + std::min(begin + 1000, commands.size())));
+    }
+    assert(toString(trade_collector.getTrades(), engine.getOrderBooks(), symbols) == run(input));
+}
+
+void test_spsc_ring() {
+    std::cout << "spsc ring" << std::endl;
+
+    spsc_ring<int> ring(5);
+    int items[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    assert(ring.tryPush(items, 10) == 8);
+    int popped[10];
+    assert(ring.tryPop(popped, 3) == 3 && popped[2] == 2);
+    assert(ring.tryPush(items + 8, 2) == 2);
+    ring.close();
+    assert(ring.pop(popped, 10) == 7 && popped[0] == 3 && popped[6] == 9);
+    assert(ring.pop(popped, 10) == 0);
+
+    // the consumer sees every item exactly once and in order, while the producer waits for free slots
+    spsc_ring<int> small_ring(16);
+    int count = 100000;
+    std::thread producer([&]() {
+        std::vector<int> batch;
+        for (int i = 0; i < count; ++i) {
+            batch.push_back(i);
+            if (batch.size() == 7 || i + 1 == count) {
+                small_ring.push(batch.data(), batch.size());
+                batch.clear();
+            }
+        }
+        small_ring.close();
+    });
+    int expected = 0;
+    size_t popped_cnt;
+    while ((popped_cnt = small_ring.pop(popped, 10)) != 0) {
+        for (size_t i = 0; i < popped_cnt; ++i) {
+            assert(popped[i] == expected++);
+        }
+    }
+    producer.join();
+    assert(expected == count);
+}
+
+void test_pipeline() {
+    std::cout << "pipeline" << std::endl;
+
+    std::vector<std::string> input = randomCommands(20000);
+    std::string text, expected;
+    for (std::string const &line : input) {
+        text += line + "\n";
+    }
+    for (std::string const &row : run(input)) {
+        expected += row + "\n";
+    }
+
+    FILE *file = std::tmpfile();
+    {
+        BufferedWriter writer(fileno(file));
+        PipelineCounts counts = runPipeline(text, writer);
+        assert(counts.commands_cnt == input.size());
+    }
+    std::string output(expected.size() + 1, '\0');
+    std::rewind(file);
+    output.resize(std::fread(&output[0], 1, output.size(), file));
+    std::fclose(file);
+    assert(output == expected);
+}
+
+void test_parallel_parser() {
+    std::cout << "parallel parser" << std::endl;
+
+    std::string text;
+    for (std::string const &line : randomCommands(200000)) {
+        text += line + "\n";
+    }
+    SymbolTable expected_symbols = SymbolTable();
+    Commands expected;
+    expected_symbols.intern("TSLA");
+    parseCommands(text, expected_symbols, expected);
+
+    // symbols are interned in the same order, so the identifiers match
+    SymbolTable symbols = SymbolTable();
+    Commands commands;
+    symbols.intern("TSLA");
+    ParallelParser parser(4);
+    parser.parse(text, symbols, commands);
+    std::string encoded, expected_encoded;
+    encodeCommands(commands, symbols, encoded);
+    encodeCommands(expected, expected_symbols, expected_encoded);
+    assert(encoded == expected_encoded);
+
+    // the first invalid line is reported, the same parser is reused after the error
+    text += "INSERT,1,AAPL,BUY,1.5\n" + text + "PULL,x\n";
+    try {
+        parser.parse(text, symbols, commands);
+        assert(false);
+    } catch (std::runtime_error const &e) {
+        assert(std::string(e.what()) == "invalid insert");
+    }
+    Commands parsed;
+    parser.parse("PULL,2\n", symbols, parsed);
+    assert(parsed.size() == 1);
+}
+
+void test_latency_histogram() {
+    std::cout << "latency histogram" << std::endl;
+
+    LatencyHistogram histogram;
+    assert(histogram.count() == 0 && histogram.percentile(50) == 0);
+    for (uint64_t value = 1; value <= 100000; ++value) {
+        histogram.record(value);
+    }
+    histogram.record(UINT64_MAX);
+    assert(histogram.count() == 100001 && histogram.min() == 1 && histogram.max() == UINT64_MAX);
+    // values are known within the size of their sub-bucket
+    for (double percent : {1.0, 50.0, 90.0, 99.0}) {
+        auto exact = uint64_t(percent * 1000);
+        uint64_t value = histogram.percentile(percent);
+        assert(exact <= value && value <= exact + exact / LatencyHistogram::SUB_BUCKETS_CNT);
+    }
+    assert(histogram.percentile(100) == UINT64_MAX);
+
+    LatencyHistogram merged;
+    merged.record(7);
+    merged.merge(histogram);
+    assert(merged.count() == 100002 && merged.percentile(0) == 1);
+
+    // engine records applied commands by kind
+    CLOBEngine engine;
+    engine.apply(Insert(1, 0, Side::BUY, 100, 10));
+    engine.apply(Insert(1, 0, Side::BUY, 100, 10));
+    engine.apply(Insert(2, 0, Side::SELL, 100, 4));
+    engine.apply(Amend(1, 100, 5));
+    engine.apply(Amend(1, 101, 5));
+    engine.apply(Pull(2));
+    engine.apply(Pull(1));
+    uint64_t expected_counts[LATENCY_KINDS_CNT] = {1, 1, 1, 1, 1};
+    for (size_t i = 0; i < LATENCY_KINDS_CNT; ++i) {
+        uint64_t count = engine.latencyHistogram(static_cast<LatencyKind>(i)).count();
+        assert(count == (LatencyTimer::ENABLED ? expected_counts[i] : 0));
+    }
+}
+
+void test_snapshot() {
+    std::cout << "snapshot" << std::endl;
+
+    std::vector<std::string> input = randomCommands(20000);
+    std::vector<std::string> head(input.begin(), input.begin() + 10000);
+    std::vector<std::string> tail(input.begin() + 10000, input.end());
+
+    SymbolTable symbols = SymbolTable();
+    TradeCollector trade_collector;
+    CLOBEngine engine = CLOBEngine(&trade_collector);
+    engine.apply(parseCommands(head, symbols));
+    std::string snapshot;
+    writeSnapshot(engine, symbols, snapshot);
+
+    // the restored engine continues exactly like the engine which ran all commands
+    SymbolTable restored_symbols = SymbolTable();
+    CLOBEngine restored = CLOBEngine(&trade_collector);
+    restoreSnapshot(snapshot, restored, restored_symbols);
+    restored.apply(parseCommands(tail, restored_symbols));
+    assert(toString(trade_collector.getTrades(), restored.getOrderBooks(), restored_symbols) == run(input));
+
+    std::string restored_snapshot;
+    CLOBEngine engine_copy;
+    SymbolTable symbols_copy = SymbolTable();
+    restoreSnapshot(snapshot, engine_copy, symbols_copy);
+    writeSnapshot(engine_copy, symbols_copy, restored_snapshot);
+    assert(restored_snapshot.size() == snapshot.size());
+
+    try {
+        CLOBEngine truncated;
+        SymbolTable truncated_symbols = SymbolTable();
+        restoreSnapshot(std::string_view(snapshot).substr(0, snapshot.size() - 1), truncated, truncated_symbols);
+        assert(false);
+    } catch (std::runtime_error const &) {
+    }
+
+    // corrupted counts are rejected before anything is allocated for them
+    std::string engine_snapshot;
+    engine.writeSnapshot(engine_snapshot);
+    auto is_rejected = [&engine_snapshot](size_t offset, uint64_t value, size_t size) {
+        std::string corrupted = engine_snapshot;
+        for (size_t i = 0; i < size; ++i) {
+            corrupted[offset + i] = static_cast<char>(value >> (8 * i));
+        }
+        try {
+            CLOBEngine corrupted_engine;
+            corrupted_engine.restoreSnapshot(corrupted);
+        } catch (std::runtime_error const &) {
+            return true;
+        }
+        return false;
+    };
+    uint64_t orders_cnt = loadLittleEndian<uint64_t>(engine_snapshot.data() + 8);
+    assert(is_rejected(8, uint64_t(1) << 60, 8));
+    assert(is_rejected(8, orders_cnt + 1, 8));
+    assert(is_rejected(16, uint32_t(1) << 31, 4));
+    assert(!is_rejected(8, orders_cnt, 8));
+
+    // levels are listed from the best one, any other order is rejected
+    SymbolTable level_symbols = SymbolTable();
+    CLOBEngine two_levels;
+    two_levels.apply(parseCommands({"INSERT,1,WEBB,BUY,10,5", "INSERT,2,WEBB,BUY,9,5"}, level_symbols));
+    std::string levels_snapshot;
+    two_levels.writeSnapshot(levels_snapshot);
+    size_t const bids_offset = 24, level_size = 28;
+    std::string swapped = levels_snapshot.substr(0, bids_offset) +
+                          levels_snapshot.substr(bids_offset + level_size, level_size) +
+                          levels_snapshot.substr(bids_offset, level_size) +
+                          levels_snapshot.substr(bids_offset + 2 * level_size);
+    CLOBEngine swapped_engine;
+    try {
+        swapped_engine.restoreSnapshot(swapped);
+        assert(false);
+    } catch (std::runtime_error const &) {
+    }
+}
+
+void test_journal() {
+    std::cout << "journal" << std::endl;
+
+    std::string path = std::string(P_tmpdir) + "/webbtraders-test-journal-" + std::to_string(getpid());
+    unlink(path.c_str());
+    std::vector<std::string> input = randomCommands(20000);
+    SymbolTable symbols = SymbolTable();
+    Commands commands = parseCommands(input, symbols);
+    Commands head(commands.begin(), commands.begin() + 12000);
+    Commands tail(commands.begin() + 12000, commands.end());
+
+    // small groups, so the journal has many of them, then a torn group left by a crash
+    JournalPolicy policy;
+    policy.sync_size = 10000;
+    {
+        SymbolTable replayed_symbols = SymbolTable();
+        JournalReader reader(path, replayed_symbols);
+        Commands replayed;
+        assert(!reader.read(replayed) && reader.position().size == 0);
+        JournalWriter writer(path, symbols, reader.position(), policy);
+        writer.append(Commands(head.begin(), head.begin() + 5000));
+        writer.append(Commands(head.begin() + 5000, head.end()));
+        assert(writer.sequence() == head.size());
+    }
+    FILE *file = std::fopen(path.c_str(), "ab");
+    std::fwrite("\x10\0\0\0\x02", 1, 5, file);
+    std::fclose(file);
+
+    // replay reproduces the commands, snapshot of the replayed engine is taken
+    SymbolTable replayed_symbols = SymbolTable();
+    replayed_symbols.intern("TSLA");
+    CLOBEngine replayed_engine;
+    JournalPosition position;
+    {
+        JournalReader reader(path, replayed_symbols);
+        Commands replayed;
+        while (reader.read(replayed)) {
+        }
+        assert(replayed.size() == head.size());
+        replayed_engine.apply(replayed);
+        position = reader.position();
+        assert(position.sequence == head.size());
+    }
+    std::string snapshot;
+    writeSnapshot(replayed_engine, replayed_symbols, snapshot, position.sequence);
+
+    // the torn group is cut off, the journal continues with the tail
+    {
+        JournalWriter writer(path, symbols, position, policy);
+        writer.append(tail);
+    }
+
+    // snapshot and the tail of the journal give the same result as all the commands
+    SymbolTable restored_symbols = SymbolTable();
+    TradeCollector trade_collector;
+    CLOBEngine restored = CLOBEngine(&trade_collector);
+    uint64_t first_sequence = restoreSnapshot(snapshot, restored, restored_symbols);
+    JournalReader reader(path, restored_symbols, first_sequence, 4096);
+    Commands replayed;
+    while (reader.read(replayed)) {
+        restored.apply(replayed);
+        replayed.clear();
+    }
+    assert(reader.position().sequence == commands.size());
+
+    TradeCollector expected_collector;
+    CLOBEngine expected = CLOBEngine(&expected_collector);
+    expected.apply(commands);
+    std::vector<Trade> const &expected_trades = expected_collector.getTrades();
+    std::vector<Trade> const &trades = trade_collector.getTrades();
+    assert(std::equal(trades.begin(), trades.end(), expected_trades.end() - trades.size(),
+                      [](Trade const &lhs, Trade const &rhs) {
+                          return lhs.aggressive_order_id == rhs.aggressive_order_id &&
+                                 lhs.passive_order_id == rhs.passive_order_id && lhs.volume == rhs.volume;
+                      }));
+    assert(toString({}, restored.getOrderBooks(), restored_symbols) ==
+           toString({}, expected.getOrderBooks(), symbols));
+    unlink(path.c_str());
+}
+
+void test_journaled_output() {
+    std::cout << "journaled output" << std::endl;
+
+    std::string path = std::string(P_tmpdir) + "/webbtraders-test-journaled-" + std::to_string(getpid());
+    std::string output_path = path + "-output";
+    unlink(path.c_str());
+    SymbolTable symbols = SymbolTable();
+    Commands commands = parseCommands(randomCommands(2000), symbols);
+    auto synced = [&path]() {
+        SymbolTable replayed_symbols = SymbolTable();
+        JournalReader reader(path, replayed_symbols);
+        Commands replayed;
+        while (reader.read(replayed)) {
+        }
+        return replayed.size();
+    };
+
+    // groups are committed by size only, so output is held until a group fills up
+    JournalPolicy policy;
+    policy.sync_interval = std::chrono::hours(1);
+    policy.sync_size = 3000;
+    JournalWriter journal(path, symbols, JournalPosition(), policy);
+    BufferedWriter writer(output_path, 0);
+    JournaledOutput output(journal, writer);
+    size_t released_cnt = 0; // commands whose output is passed to the writer
+    size_t output_size = 0;
+    bool is_held = false;
+    for (size_t offset = 0; offset < commands.size(); offset += 100) {
+        journal.append(Commands(commands.begin() + offset, commands.begin() + offset + 100));
+        std::string text = "trades of " + std::to_string(offset) + "\n";
+        output_size += text.size();
+        output.write(text);
+        if (output.held() == 0) {
+            released_cnt = journal.sequence();
+        } else {
+            is_held = true;
+        }
+        assert(journal.syncedSequence() <= journal.sequence());
+        assert(synced() >= released_cnt);
+    }
+    assert(is_held && writer.written() + output.held() == output_size);
+    output.flush();
+    assert(output.held() == 0 && synced() == commands.size());
+    assert(journal.syncedSequence() == commands.size());
+    assert(writer.written() == output_size);
+    unlink(path.c_str());
+    unlink(output_path.c_str());
+}
+
+void test_feed() {
+    std::cout << "feed" << std::endl;
+
+    // a sweep through two levels reports every trade and then the level it finished
+    SymbolTable symbols = SymbolTable();
+    std::string text;
+    FeedFormatter feed_formatter(text, symbols);
+    CLOBEngine engine = CLOBEngine(&feed_formatter, 16, &feed_formatter);
+    engine.apply(parseCommands({"INSERT,1,WEBB,SELL,10,5", "INSERT,2,WEBB,SELL,10,5", "INSERT,3,WEBB,SELL,11,5",
+                                "INSERT,4,WEBB,BUY,11,12", "AMEND,3,11,2", "PULL,3"}, symbols));
+    assert(text == "L,WEBB,SELL,10,5\nL,WEBB,SELL,10,10\nL,WEBB,SELL,11,5\n"
+                   "T,WEBB,10,5,4,1\nT,WEBB,10,5,4,2\nL,WEBB,SELL,10,0\nT,WEBB,11,2,4,3\nL,WEBB,SELL,11,3\n"
+                   "L,WEBB,SELL,11,2\nL,WEBB,SELL,11,0\n");
+
+    // books rebuilt from the updates are the books of the engine
+    struct BookBuilder : public BookListener {
+        std::map<std::tuple<SymbolId, Side, Price>, Volume> levels;
+
+        void onLevelUpdate(LevelUpdate const &update) override {
+            if (update.volume == 0) {
+                levels.erase({update.symbol, update.side, update.price});
+            } else {
+                levels[{update.symbol, update.side, update.price}] = update.volume;
+            }
+        }
+    } book_builder;
+    SymbolTable random_symbols = SymbolTable();
+    CLOBEngine random_engine = CLOBEngine(nullptr, 16, &book_builder);
+    random_engine.apply(parseCommands(randomCommands(20000), random_symbols));
+    size_t levels_cnt = 0;
+    for (OrderBook const &order_book : random_engine.getOrderBooks()) {
+        for (OrderBook::Item const &item : order_book.bids) {
+            assert(book_builder.levels.at({order_book.symbol, Side::BUY, item.price}) == item.volume);
+        }
+        for (OrderBook::Item const &item : order_book.asks) {
+            assert(book_builder.levels.at({order_book.symbol, Side::SELL, item.price}) == item.volume);
+        }
+        levels_cnt += order_book.bids.size() + order_book.asks.size();
+    }
+    assert(levels_cnt == book_builder.levels.size());
+}
+
+void test_depth() {
+    std::cout << "depth" << std::endl;
+
+    SymbolTable symbols = SymbolTable();
+    CLOBEngine engine = CLOBEngine();
+    engine.apply(parseCommands({"INSERT,1,WEBB,BUY,10,5", "INSERT,2,WEBB,BUY,11,3", "INSERT,3,WEBB,BUY,9,7",
+                                "INSERT,4,WEBB,SELL,12,4", "INSERT,5,WEBB,BUY,11,2"}, symbols));
+    OrderBook order_book = engine.getOrderBooks().at(0);
+    Price bid_11 = order_book.bids[0].price;
+    Price bid_10 = order_book.bids[1].price;
+    Price ask_12 = order_book.asks[0].price;
+
+    BestBidOffer best_bid_offer = engine.getBestBidOffer(order_book.symbol);
+    assert(best_bid_offer.bid && best_bid_offer.bid->price == bid_11 && best_bid_offer.bid->volume == 5);
+    assert(best_bid_offer.ask && best_bid_offer.ask->price == ask_12 && best_bid_offer.ask->volume == 4);
+    assert(!engine.getBestBidOffer(order_book.symbol + 1).bid);
+
+    std::vector<OrderBook::Item> levels;
+    engine.getTopLevels(order_book.symbol, Side::BUY, 2, levels);
+    assert(levels.size() == 2 && levels[0].price == bid_11 && levels[1].price == bid_10 && levels[1].volume == 5);
+    engine.getTopLevels(order_book.symbol, Side::SELL, 10, levels);
+    assert(levels.size() == 1 && levels[0].volume == 4);
+
+    assert(engine.getVolumeTo(order_book.symbol, Side::BUY, bid_10) == 10);
+    assert(engine.getVolumeTo(order_book.symbol, Side::BUY, order_book.bids[2].price) == 17);
+    assert(engine.getVolumeTo(order_book.symbol, Side::SELL, ask_12 - 1) == 0);
+
+    // queries agree with the full books
+    SymbolTable random_symbols = SymbolTable();
+    CLOBEngine random_engine = CLOBEngine();
+    random_engine.apply(parseCommands(randomCommands(20000), random_symbols));
+    for (OrderBook const &random_book : random_engine.getOrderBooks()) {
+        random_engine.getTopLevels(random_book.symbol, Side::SELL, 3, levels);
+        assert(levels.size() == std::min<size_t>(3, random_book.asks.size()));
+        int64_t volume = 0;
+        for (size_t i = 0; i < random_book.asks.size(); ++i) {
+            volume += random_book.asks[i].volume;
+            if (i < levels.size()) {
+                assert(levels[i].price == random_book.asks[i].price && levels[i].volume == random_book.asks[i].volume);
+            }
+            assert(random_engine.getVolumeTo(random_book.symbol, Side::SELL, random_book.asks[i].price) == volume);
+        }
+    }
+}
+
+/**
+ * Level updates in the order they were reported
+ */
+struct LevelUpdateCollector : public BookListener {
+    std::vector<std::tuple<SymbolId, Side, Price, Volume>> updates;
+
+    void onLevelUpdate(LevelUpdate const &update) override {
+        updates.emplace_back(update.symbol, update.side, update.price, update.volume);
+    }
+};
+
+template<template<Side> class BookSide>
+void checkStorage(Commands const &commands, std::vector<std::string> const &expected,
+                  std::vector<std::tuple<SymbolId, Side, Price, Volume>> const &expected_updates,
+                  std::string const &expected_snapshot, SymbolTable const &symbols) {
+    TradeCollector trade_collector;
+    LevelUpdateCollector update_collector;
+    BasicCLOBEngine<BookSide> engine(&trade_collector, 16, &update_collector);
+    engine.apply(commands);
+    assert(toString(trade_collector.getTrades(), engine.getOrderBooks(), symbols) == expected);
+    assert(update_collector.updates == expected_updates);
+    std::string snapshot;
+    engine.writeSnapshot(snapshot);
+    assert(snapshot == expected_snapshot);
+
+    // depth queries agree with the books
+    std::vector<OrderBook::Item> levels;
+    for (OrderBook const &order_book : engine.getOrderBooks()) {
+        BestBidOffer best_bid_offer = engine.getBestBidOffer(order_book.symbol);
+        assert(best_bid_offer.bid.has_value() == !order_book.bids.empty());
+        assert(best_bid_offer.ask.has_value() == !order_book.asks.empty());
+        if (!order_book.bids.empty()) {
+            assert(best_bid_offer.bid->price == order_book.bids[0].price);
+            assert(best_bid_offer.bid->volume == order_book.bids[0].volume);
+        }
+        if (!order_book.asks.empty()) {
+            assert(best_bid_offer.ask->price == order_book.asks[0].price);
+            assert(best_bid_offer.ask->volume == order_book.asks[0].volume);
+        }
+        engine.getTopLevels(order_book.symbol, Side::SELL, 3, levels);
+        assert(levels.size() == std::min<size_t>(3, order_book.asks.size()));
+        for (size_t i = 0; i < levels.size(); ++i) {
+            assert(levels[i].price == order_book.asks[i].price && levels[i].volume == order_book.asks[i].volume);
+        }
+    }
+
+    // snapshots don't depend on the storage
+    CLOBEngine restored;
+    restored.restoreSnapshot(snapshot);
+    assert(toString({}, restored.getOrderBooks(), symbols) == toString({}, engine.getOrderBooks(), symbols));
+}
+
+void test_storages() {
+    std::cout << "storages" << std::endl;
+
+    std::vector<std::string> input = randomCommands(20000);
+    SymbolTable symbols = SymbolTable();
+    Commands commands = parseCommands(input, symbols);
+    LevelUpdateCollector update_collector;
+    CLOBEngine engine = CLOBEngine(nullptr, 16, &update_collector);
+    engine.apply(commands);
+    std::string snapshot;
+    engine.writeSnapshot(snapshot);
+
+    checkStorage<price_tree>(commands, run(input), update_collector.updates, snapshot, symbols);
+    checkStorage<order_heap>(commands, run(input), update_collector.updates, snapshot, symbols);
+}
+
+void test_apply_batch() {
+    std::cout << "apply batch" << std::endl;
+
+    // prefetching doesn't change results, including orders amended and pulled right after their inserts
+    std::vector<std::string> input = randomCommands(20000);
+    input.insert(input.end(), {"INSERT,100001,WEBB,BUY,10,5", "PULL,100001", "INSERT,100002,WEBB,SELL,10,5",
+                               "AMEND,100002,10,3", "INSERT,100003,WEBB,BUY,10,4"});
+    SymbolTable symbols = SymbolTable();
+    TradeCollector trade_collector;
+    LevelUpdateCollector update_collector;
+    CLOBEngine engine = CLOBEngine(&trade_collector, 16, &update_collector);
+    engine.applyBatch(parseCommands(input, symbols));
+    assert(toString(trade_collector.getTrades(), engine.getOrderBooks(), symbols) == run(input));
+
+    SymbolTable sequential_symbols = SymbolTable();
+    LevelUpdateCollector sequential_update_collector;
+    CLOBEngine sequential_engine = CLOBEngine(nullptr, 16, &sequential_update_collector);
+    sequential_engine.apply(parseCommands(input, sequential_symbols));
+    assert(update_collector.updates == sequential_update_collector.updates);
+}
+
+void test_dead_orders() {
+    std::cout << "dead orders" << std::endl;
+
+    SymbolTable symbols = SymbolTable();
+    TradeCollector trade_collector;
+    CLOBEngine engine = CLOBEngine(&trade_collector);
+    engine.apply(parseCommands({"INSERT,1,WEBB,SELL,10,5", "INSERT,2,WEBB,SELL,11,5", "INSERT,3,WEBB,BUY,10,5",
+                                "PULL,2", "INSERT,4,WEBB,BUY,9,5", "AMEND,4,12,5"}, symbols));
+    // filled, pulled and fully matched orders are forgotten, the order which rests after its amend isn't
+    assert(!engine.hasOrder(1) && !engine.hasOrder(2) && !engine.hasOrder(3));
+    assert(engine.hasOrder(4));
+
+    // identifiers of finished orders are still rejected
+    engine.apply(parseCommands({"INSERT,1,WEBB,SELL,12,5", "INSERT,2,WEBB,BUY,9,1", "INSERT,3,WEBB,SELL,20,1",
+                                "AMEND,2,12,5", "PULL,1"}, symbols));
+    assert(trade_collector.getTrades().size() == 1);
+    std::vector<OrderBook> order_books = engine.getOrderBooks();
+    assert(order_books.size() == 1 && order_books[0].bids.size() == 1 && order_books[0].asks.empty());
+
+    // sparse and negative identifiers
+    OrderIdSet ids;
+    for (OrderId order_id : {OrderId(0), OrderId(1023), OrderId(1024), OrderId(-1), OrderId(1) << 40}) {
+        assert(!ids.contains(order_id));
+        assert(ids.insert(order_id));
+        assert(!ids.insert(order_id));
+        assert(ids.contains(order_id));
+    }
+    assert(!ids.contains(2) && !ids.contains(-2) && ids.pagesCount() == 4 && ids.bitmapsCount() == 0);
+
+    // sparse identifiers don't allocate bitmaps, a page which fills up does
+    OrderIdSet sparse_ids;
+    for (OrderId order_id = 0; order_id < 10000; ++order_id) {
+        assert(sparse_ids.insert(order_id << 20));
+    }
+    assert(sparse_ids.pagesCount() == 10000 && sparse_ids.bitmapsCount() == 0);
+    for (OrderId order_id = 1; order_id < 100; ++order_id) {
+        assert(sparse_ids.insert(order_id * 7));
+        assert(!sparse_ids.insert(order_id * 7));
+    }
+    assert(sparse_ids.pagesCount() == 10000 && sparse_ids.bitmapsCount() == 1);
+    for (OrderId order_id = 0; order_id < 1024; ++order_id) {
+        assert(sparse_ids.contains(order_id) == (order_id % 7 == 0 && order_id < 700));
+    }
+
+    // both kinds of pages survive a snapshot
+    std::string snapshot;
+    sparse_ids.writeSnapshot(snapshot);
+    ByteReader reader(snapshot, "order identifiers");
+    OrderIdSet restored_ids;
+    restored_ids.restoreSnapshot(reader);
+    assert(restored_ids.pagesCount() == 10000 && restored_ids.bitmapsCount() == 1);
+    for (OrderId order_id = 0; order_id < 10000; ++order_id) {
+        assert(restored_ids.contains(order_id << 20) && !restored_ids.contains((order_id << 20) + 1));
+    }
+    assert(restored_ids.contains(693) && !restored_ids.contains(694));
+
+    // a number of pages which doesn't fit into the data and duplicate offsets of a page are rejected
+    auto is_rejected = [](std::string const &data) {
+        ByteReader data_reader(data, "order identifiers");
+        OrderIdSet rejected_ids;
+        try {
+            rejected_ids.restoreSnapshot(data_reader);
+        } catch (std::runtime_error const &) {
+            return true;
+        }
+        return false;
+    };
+    std::string page;
+    appendLittleEndian<int64_t>(page, 3);
+    appendLittleEndian<uint16_t>(page, 2);
+    appendLittleEndian<uint16_t>(page, 5);
+    std::string huge_pages_cnt, duplicate_offsets, distinct_offsets;
+    appendLittleEndian<uint64_t>(huge_pages_cnt, uint64_t(1) << 60);
+    huge_pages_cnt += page;
+    appendLittleEndian<uint16_t>(huge_pages_cnt, 6);
+    appendLittleEndian<uint64_t>(duplicate_offsets, 1);
+    duplicate_offsets += page;
+    appendLittleEndian<uint16_t>(duplicate_offsets, 5);
+    appendLittleEndian<uint64_t>(distinct_offsets, 1);
+    distinct_offsets += page;
+    appendLittleEndian<uint16_t>(distinct_offsets, 6);
+    assert(is_rejected(huge_pages_cnt) && is_rejected(duplicate_offsets) && !is_rejected(distinct_offsets));
+}
+
+template<bool LazyRemoval>
+void checkPriorityQueue() {
+    struct Item {
+        int priority;
+        int key;
+    };
+    struct ItemComparator {
+        bool operator()(Item const &lhs, Item const &rhs) const {
+            return lhs.priority != rhs.priority ? lhs.priority < rhs.priority : lhs.key < rhs.key;
+        }
+    };
+    priority_queue<int, Item, ItemComparator, LazyRemoval> queue([](Item const &item) { return item.key; }, 0.5);
+    std::map<int, int> expected; // key to priority
+
+    // keys are reused after removals, like handles of released orders
+    uint64_t state = 1;
+    auto random = [&state](int bound) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<int>((state >> 33) % bound);
+    };
+    for (int i = 0; i < 20000; ++i) {
+        int key = random(500);
+        auto it = queue.find(key);
+        assert((it != queue.end()) == (expected.count(key) != 0));
+        if (it == queue.end()) {
+            int priority = random(1000);
+            queue.push(Item{priority, key});
+            expected[key] = priority;
+        } else if (random(4) != 0) {
+            queue.remove(it);
+            expected.erase(key);
+        } else {
+            expected.erase(queue.top().key);
+            queue.pop();
+        }
+        assert(queue.empty() == expected.empty());
+        if (!expected.empty()) {
+            auto it_best = std::min_element(expected.begin(), expected.end(), [](auto const &lhs, auto const &rhs) {
+                return ItemComparator()(Item{lhs.second, lhs.first}, Item{rhs.second, rhs.first});
+            });
+            assert(queue.top().key == it_best->first);
+        }
+    }
+    size_t items_cnt = 0;
+    queue.forEach([&](Item const &item) {
+        assert(expected.at(item.key) == item.priority);
+        ++items_cnt;
+    });
+    assert(items_cnt == expected.size());
+}
+
+void test_priority_queue() {
+    std::cout << "priority queue" << std::endl;
+
+    checkPriorityQueue<false>();
+    checkPriorityQueue<true>();
+}
+
+void test_flat_hash_map() {
+    std::cout << "flat hash map" << std::endl;
+
+    // starts small, so the table is rehashed several times, erasures shift runs of colliding keys back
+    flat_hash_map<int64_t, int64_t> map(2);
+    std::unordered_map<int64_t, int64_t> expected;
+    uint64_t state = 1;
+    auto random = [&state](int64_t bound) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<int64_t>((state >> 33) % bound);
+    };
+    for (int i = 0; i < 50000; ++i) {
+        // negative keys and keys far apart, which differ only in high bits
+        int64_t key = random(8) == 0 ? (random(64) - 32) * (int64_t(1) << 40) : random(2000) - 1000;
+        switch (random(5)) {
+            case 0:
+            case 1: {
+                auto [value, is_inserted] = map.insert(key, i);
+                auto [it_expected, is_expected_inserted] = expected.emplace(key, i);
+                assert(is_inserted == is_expected_inserted && *value == it_expected->second);
+                break;
+            }
+            case 2:
+                map[key] += i;
+                expected[key] += i;
+                break;
+            case 3:
+                assert(map.erase(key) == (expected.erase(key) != 0));
+                break;
+            default:
+                if (i % 1000 == 0) {
+                    map.reserve(expected.size() * 2);
+                }
+                break;
+        }
+        assert(map.size() == expected.size());
+        int64_t const *value = map.find(key);
+        assert((value != nullptr) == (expected.count(key) != 0));
+        assert(value == nullptr || *value == expected.at(key));
+    }
+    for (auto const &[key, value] : expected) {
+        assert(map.find(key) != nullptr && *map.find(key) == value);
+    }
+    size_t entries_cnt = 0;
+    map.forEach([&](int64_t key, int64_t value) {
+        assert(expected.at(key) == value);
+        ++entries_cnt;
+    });
+    assert(entries_cnt == expected.size());
+}
+
+void test_object_pool() {
+    std::cout << "object pool" << std::endl;
+
+    // small slabs, so objects span several of them
+    object_pool<int64_t, 4> pool;
+    std::vector<PoolHandle> handles;
+    std::vector<int64_t const *> addresses;
+    for (int64_t i = 0; i < 100; ++i) {
+        handles.push_back(pool.allocate(i));
+        addresses.push_back(&pool[handles.back()]);
+    }
+    assert(pool.size() == 100);
+
+    // released slots are reused before new ones, objects don't move when slabs are added
+    pool.free(handles[10]);
+    pool.free(handles[20]);
+    assert(pool.size() == 98);
+    PoolHandle first = pool.allocate(-1);
+    PoolHandle second = pool.allocate(-2);
+    assert(std::min(first, second) == handles[10] && std::max(first, second) == handles[20]);
+    assert(pool.size() == 100);
+    for (int64_t i = 100; i < 1000; ++i) {
+        handles.push_back(pool.allocate(i));
+    }
+    assert(pool.size() == 1000);
+    for (int64_t i = 0; i < 100; ++i) {
+        assert(&pool[handles[i]] == addresses[i]);
+        assert(i == 10 || i == 20 || pool[handles[i]] == i);
+    }
+    for (int64_t i = 100; i < 1000; ++i) {
+        assert(pool[handles[i]] == i);
+    }
+}
 
 int main() {
     test_insert();
@@ -424,6 +1344,27 @@ int main() {
     test_insert_4();
     test_insert_5();
     test_insert_6();
+    test_pull_inner_level();
+    test_parse_text();
+    test_stream();
+    test_binary_commands();
+    test_format_prices();
+    test_sharded();
+    test_spsc_ring();
+    test_pipeline();
+    test_parallel_parser();
+    test_latency_histogram();
+    test_snapshot();
+    test_journal();
+    test_journaled_output();
+    test_feed();
+    test_depth();
+    test_storages();
+    test_apply_batch();
+    test_dead_orders();
+    test_priority_queue();
+    test_flat_hash_map();
+    test_object_pool();
 
     test_many_trades();
     std::cout << "OK" << std::endl;